@@ -0,0 +1,207 @@
+﻿/**********************************************************************************************
+*   Unit behavior trees (bytecode VM)
+**********************************************************************************************/
+
+#include "battle_behavior.h"
+#include <assert.h>
+
+// 步兵: 打最近的, 否則前進, 看不到敵人就偵察
+static const BehaviorNode footmanTree[] = {
+    { BT_SELECTOR, 0, 3 },
+        { BT_ATTACK_NEAREST, 0, 0 },
+        { BT_ADVANCE, 0, 0 },
+        { BT_SCOUT, 0, 0 },
+};
+
+// 弓兵: 集中射擊血最少的
+static const BehaviorNode archerTree[] = {
+    { BT_SELECTOR, 0, 3 },
+        { BT_ATTACK_WEAKEST, 0, 0 },
+        { BT_ADVANCE, 0, 0 },
+        { BT_SCOUT, 0, 0 },
+};
+
+// 騎士: 優先砍弓兵, 其次補刀
+static const BehaviorNode knightTree[] = {
+    { BT_SELECTOR, 0, 4 },
+        { BT_ATTACK_TYPE, GameData::UNIT_ARCHER, 0 },
+        { BT_ATTACK_WEAKEST, 0, 0 },
+        { BT_ADVANCE, 0, 0 },
+        { BT_SCOUT, 0, 0 },
+};
+
+// 槍兵: 優先刺騎士; 騎士衝過來時原地架槍, 讓它自己走進攻擊範圍
+static const BehaviorNode spearmanTree[] = {
+    { BT_SELECTOR, 0, 5 },
+        { BT_ATTACK_TYPE, GameData::UNIT_KNIGHT, 0 },
+        { BT_ATTACK_NEAREST, 0, 0 },
+        { BT_SEQUENCE, 0, 3 },
+            { BT_ENEMY_IS_TYPE, GameData::UNIT_KNIGHT, 0 },
+            { BT_ENEMY_WITHIN, 2, 0 },
+            { BT_HOLD, 0, 0 },
+        { BT_ADVANCE, 0, 0 },
+        { BT_SCOUT, 0, 0 },
+};
+
+// 程式區滿了回傳 false (不寫入)
+static bool EmitBehavior(BehaviorLibrary *library, int op, int arg)
+{
+    if (library->size >= BEHAVIOR_MAX_CODE) return false;
+    library->code[library->size++] = BehaviorInstr{ (unsigned char)op, (unsigned char)arg, 0 };
+    return true;
+}
+
+// 編譯 nodes[at] 為根的子樹, 回傳這棵子樹之後的下一個節點; 超出 BEHAVIOR_MAX_CODE / BEHAVIOR_MAX_CHILDREN 回傳 -1
+static int CompileBehaviorNode(BehaviorLibrary *library, const BehaviorNode *nodes, int at)
+{
+    const BehaviorNode *node = &nodes[at++];
+    if ((node->arg < 0) || (node->arg > 255)) return -1;
+
+    if ((node->op == BT_SELECTOR) || (node->op == BT_SEQUENCE))
+    {
+        if ((node->childCount < 1) || (node->childCount > BEHAVIOR_MAX_CHILDREN)) return -1;
+
+        int jumps[BEHAVIOR_MAX_CHILDREN];
+        int jumpCount = 0;
+        for (int c = 0; c < node->childCount; c++)
+        {
+            at = CompileBehaviorNode(library, nodes, at);
+            if (at < 0) return -1;
+            if (c == node->childCount - 1) break;
+            jumps[jumpCount++] = library->size;
+            if (!EmitBehavior(library, (node->op == BT_SELECTOR)? BT_JUMP_IF_SUCCESS : BT_JUMP_IF_FAILURE, 0)) return -1;
+        }
+
+        // sequence 失敗時, 前面成功的子節點寫入的 decision 不算數
+        if ((node->op == BT_SEQUENCE) && !EmitBehavior(library, BT_CLEAR_IF_FAILURE, 0)) return -1;
+        for (int j = 0; j < jumpCount; j++) library->code[jumps[j]].jump = (unsigned short)((node->op == BT_SEQUENCE)? library->size - 1 : library->size);
+    }
+    else if (node->op == BT_INVERT)
+    {
+        if (node->childCount != 1) return -1;
+        at = CompileBehaviorNode(library, nodes, at);
+        if ((at < 0) || !EmitBehavior(library, BT_NOT, 0)) return -1;
+    }
+    else if (!EmitBehavior(library, node->op, node->arg)) return -1;
+    return at;
+}
+
+// 編譯失敗時丟掉這棵樹已寫入的部分, 改用 entry 0 的空程式 (永遠 BEHAVIOR_HOLD)
+static bool CompileBehaviorTree(BehaviorLibrary *library, int type, const BehaviorNode *nodes)
+{
+    int entry = library->size;
+    if ((CompileBehaviorNode(library, nodes, 0) < 0) || !EmitBehavior(library, BT_END, 0))
+    {
+        library->size = entry;
+        library->entry[type] = 0;
+        return false;
+    }
+    library->entry[type] = entry;
+    return true;
+}
+
+static BehaviorLibrary CompileBehaviorLibrary(void)
+{
+    BehaviorLibrary library;
+    library.size = 0;
+    EmitBehavior(&library, BT_END, 0);
+    for (int type = 0; type < GameData::UNIT_TYPE_COUNT; type++) library.entry[type] = 0;
+
+    bool compiled = CompileBehaviorTree(&library, GameData::UNIT_FOOTMAN, footmanTree);
+    compiled &= CompileBehaviorTree(&library, GameData::UNIT_ARCHER, archerTree);
+    compiled &= CompileBehaviorTree(&library, GameData::UNIT_KNIGHT, knightTree);
+    compiled &= CompileBehaviorTree(&library, GameData::UNIT_SPEARMAN, spearmanTree);
+    assert(compiled && "behavior tree exceeds BEHAVIOR_MAX_CODE or BEHAVIOR_MAX_CHILDREN");
+    (void)compiled;
+    return library;
+}
+
+const BehaviorLibrary *GetBehaviorLibrary(void)
+{
+    static const BehaviorLibrary library = CompileBehaviorLibrary();    // 第一次呼叫時編譯 (thread-safe)
+    return &library;
+}
+
+// 射程內且看得到的敵人中, 依 op 挑一個; 同分取格子編號小的 (與 FindVisibleTarget 相同)
+// 直接掃敵隊的 dense 陣列, 不用再由格子反查單位
+int SelectBehaviorTarget(const UnitStore *units, const LineOfSightTable *lineOfSight, int u, int op, int arg)
+{
+    int width = lineOfSight->width;
+    const CellMask *visible = &lineOfSight->visible[units->y[u]*width + units->x[u]];
+    Team enemyTeam = GetEnemyTeam(GetUnitTeam(u));
+
+    int best = -1;
+    Fixed bestHP = 0;
+    int bestDist = 0;
+    int bestCell = 0;
+    for (int e = GetTeamBegin(enemyTeam); e < GetTeamEnd(units, enemyTeam); e++)
+    {
+        if ((op == BT_ATTACK_TYPE) && (units->type[e] != arg)) continue;
+        int d = abs(units->x[e] - units->x[u]) + abs(units->y[e] - units->y[u]);
+        int cell = units->y[e]*width + units->x[e];
+        if ((d > units->range[u]) || !GetCellMaskBit(visible, cell)) continue;
+
+        // WEAKEST 先比 hp, 其他只比距離
+        Fixed hp = (op == BT_ATTACK_WEAKEST)? units->hp[e] : 0;
+        if ((best < 0) || (hp < bestHP) || ((hp == bestHP) && ((d < bestDist) || ((d == bestDist) && (cell < bestCell)))))
+        {
+            best = e;
+            bestHP = hp;
+            bestDist = d;
+            bestCell = cell;
+        }
+    }
+    return best;
+}
+
+#if defined(BATTLE_BENCHMARK)
+#include "raylib.h"
+
+// 8x16 棋盤站滿兩隊 (兵種輪流), 每個單位各跑一次 RunBehavior (與 battle_engine.h 的 Decide 相同的路徑);
+// perception 事先算好, 量的是直譯器本身; 對照組是原本寫死的 FindVisibleTarget (只有「打最近的」這一條規則)
+void RunBehaviorBenchmark(void)
+{
+    const int width = 8;
+    const int height = 16;
+    const int rounds = 2000;
+
+    static int walls[width*height];
+    static LineOfSightTable lineOfSight;
+    static UnitStore units;
+    for (int c = 0; c < width*height; c++) walls[c] = 0;
+    BuildLineOfSightTable(&lineOfSight, walls, width, height);
+    InitUnitStore(&units);
+    for (int c = 0; c < width*height; c++)
+    {
+        Team team = (c < width*height/2)? TEAM_RED : TEAM_BLUE;
+        if (units.count[team] < MAX_TEAM_UNITS) AddCatalogUnit(&units, team, c%width, c/width, c%GameData::UNIT_TYPE_COUNT, 1);
+    }
+
+    static int order[MAX_BATTLE_UNITS];
+    static BehaviorPerception perceptions[MAX_BATTLE_UNITS];   // 依 dense index
+    int count = 0;
+    for (int t = 0; t < TEAM_COUNT; t++)
+    {
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(&units, (Team)t); i++)
+        {
+            int e = GetTeamBegin(GetEnemyTeam((Team)t));
+            order[count++] = i;
+            perceptions[i] = BehaviorPerception{ e, abs(units.x[e] - units.x[i]) + abs(units.y[e] - units.y[i]) };
+        }
+    }
+
+    int checksum = 0;
+    double start = GetTime();
+    for (int r = 0; r < rounds; r++)
+        for (int k = 0; k < count; k++) checksum += RunBehavior(&units, &lineOfSight, order[k], [](int u) { return perceptions[u]; }).target;
+    double vmTime = GetTime() - start;
+
+    start = GetTime();
+    for (int r = 0; r < rounds; r++)
+        for (int k = 0; k < count; k++) checksum += FindVisibleTarget(&lineOfSight, &units, order[k]);
+    double directTime = GetTime() - start;
+
+    TraceLog(LOG_INFO, "BENCHMARK: behavior trees, %d units, %d instructions: vm %.1f ns, hard-coded target pick %.1f ns per decision (checksum %d)",
+        count, GetBehaviorLibrary()->size, vmTime*1e9/rounds/count, directTime*1e9/rounds/count, checksum);
+}
+#endif
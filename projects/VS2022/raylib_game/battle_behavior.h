@@ -0,0 +1,162 @@
+﻿/**********************************************************************************************
+*   Unit behavior trees (bytecode VM)
+*
+*   每個兵種 (GameData::UnitTypeIndex) 的行為以 behavior tree 撰寫 (battle_behavior.cpp 的節點表),
+*   第一次使用時編譯成一段 bytecode, 之後所有畫面 / 執行緒共用同一份唯讀的程式
+*
+*   編譯方式: 只有一個 status 暫存器, 不需要堆疊
+*       selector: 每個子節點後面接 JUMP_IF_SUCCESS 到結尾
+*       sequence: 每個子節點後面接 JUMP_IF_FAILURE 到結尾的 CLEAR_IF_FAILURE (失敗時清掉前面子節點寫的 decision)
+*       invert  : 子節點後面接 NOT
+*   超過 BEHAVIOR_MAX_CODE 個指令或 BEHAVIOR_MAX_CHILDREN 個子節點的樹編譯失敗 (debug 版 assert),
+*   該兵種改用空程式, 永遠 BEHAVIOR_HOLD
+*   直譯器是一個 switch 迴圈, 沒有 virtual dispatch, 也不配置記憶體; 它是 header 裡以 perceive 為參數的 template,
+*   每個 BattleEngine 實例的 Targeting::Perceive 直接 inline 進來, 不經過函式指標
+*
+*   葉節點只讀 UnitStore / 視線表與畫面提供的 BehaviorPerception, 結果是一個 BehaviorDecision,
+*   由呼叫的畫面依自己的規則執行 (GAMEPLAY 走合作尋路, SETUP 直走一步); 程式失敗時為 BEHAVIOR_HOLD
+*   RunBehavior 的 perception 在第一次用到時才向畫面要 (ENEMY_* / ADVANCE / SCOUT), 射程內就能出手的單位
+*   不用找最近的敵人 (GAMEPLAY 找敵人要算一次距離場)
+*   定義 BATTLE_BENCHMARK 時 RunBehaviorBenchmark() 比較直譯器與原本寫死的選目標所花的時間
+**********************************************************************************************/
+
+#pragma once
+#include "battle_units.h"
+#include "battle_los.h"
+#include "game_unit.h"
+
+#define BEHAVIOR_MAX_CODE       256
+#define BEHAVIOR_MAX_CHILDREN   16
+
+typedef enum {
+    // 撰寫用, 編譯後消失
+    BT_SELECTOR = 0,
+    BT_SEQUENCE,
+    BT_INVERT,
+
+    // 控制
+    BT_END,
+    BT_JUMP_IF_SUCCESS,
+    BT_JUMP_IF_FAILURE,
+    BT_NOT,
+    BT_CLEAR_IF_FAILURE,        // status 為失敗時把 decision 重設為 HOLD
+
+    // 條件
+    BT_ENEMY_WITHIN,            // 最近的敵人距離 <= arg
+    BT_ENEMY_IS_TYPE,           // 最近的敵人是 arg 兵種
+
+    // 行動 (成功時寫入 decision)
+    BT_ATTACK_NEAREST,          // 射程內看得到的敵人中最近的
+    BT_ATTACK_WEAKEST,          // 射程內看得到的敵人中 hp 最低的
+    BT_ATTACK_TYPE,             // 射程內看得到的 arg 兵種中最近的
+    BT_ADVANCE,                 // 往最近的敵人前進
+    BT_SCOUT,                   // 沒有已知的敵人時去偵察
+    BT_HOLD,                    // 原地不動
+} BehaviorOp;
+
+typedef enum {
+    BEHAVIOR_HOLD = 0,
+    BEHAVIOR_ATTACK,
+    BEHAVIOR_ADVANCE,
+    BEHAVIOR_SCOUT,
+} BehaviorCommand;
+
+// 撰寫用的節點, 以 pre-order 排列: 組合節點後面緊接著 childCount 棵子樹
+typedef struct BehaviorNode {
+    BehaviorOp op;
+    int arg;
+    int childCount;
+} BehaviorNode;
+
+typedef struct BehaviorInstr {
+    unsigned char op;
+    unsigned char arg;
+    unsigned short jump;        // JUMP_* 的目的地
+} BehaviorInstr;
+
+typedef struct BehaviorLibrary {
+    BehaviorInstr code[BEHAVIOR_MAX_CODE];
+    int size;
+    int entry[GameData::UNIT_TYPE_COUNT];
+} BehaviorLibrary;
+
+// 畫面在行動前替單位找好的資訊 (怎麼找由畫面決定, 例如 GAMEPLAY 只算我方看得到的敵人)
+typedef struct BehaviorPerception {
+    int enemy;                  // 最近的已知敵人 dense index, -1 = 沒有
+    int enemyDistance;          // 走到那裡的步數, 有地形成本時換算成空地步數 (enemy < 0 時無意義)
+} BehaviorPerception;
+
+typedef struct BehaviorDecision {
+    BehaviorCommand command;
+    int target;                 // ATTACK: 目標; ADVANCE: perception.enemy; 其他為 -1
+} BehaviorDecision;
+
+const BehaviorLibrary *GetBehaviorLibrary(void);
+
+// 射程內且看得到的敵人中, 依 op (BT_ATTACK_*) 挑一個; 沒有回傳 -1
+int SelectBehaviorTarget(const UnitStore *units, const LineOfSightTable *lineOfSight, int u, int op, int arg);
+
+// 單位 u 依自己兵種的程式做決定; 需要敵人資訊時才呼叫 perceive(u) -> BehaviorPerception, 每次決定最多呼叫一次
+template <typename Perceive>
+inline BehaviorDecision RunBehavior(const UnitStore *units, const LineOfSightTable *lineOfSight, int u, Perceive perceive)
+{
+    const BehaviorLibrary *library = GetBehaviorLibrary();
+    const BehaviorInstr *code = library->code;
+    int pc = library->entry[units->type[u]];
+
+    BehaviorDecision decision = { BEHAVIOR_HOLD, -1 };
+    bool status = false;
+    BehaviorPerception perception = { -1, 0 };
+    bool perceived = false;
+    auto sense = [&]() -> const BehaviorPerception & {
+        if (!perceived) { perception = perceive(u); perceived = true; }
+        return perception;
+    };
+
+    while (true)
+    {
+        const BehaviorInstr *instr = &code[pc++];
+        switch (instr->op)
+        {
+            case BT_END: return decision;
+            case BT_JUMP_IF_SUCCESS: if (status) pc = instr->jump; break;
+            case BT_JUMP_IF_FAILURE: if (!status) pc = instr->jump; break;
+            case BT_NOT: status = !status; break;
+            case BT_CLEAR_IF_FAILURE: if (!status) decision = BehaviorDecision{ BEHAVIOR_HOLD, -1 }; break;
+
+            case BT_ENEMY_WITHIN:
+                status = (sense().enemy >= 0) && (sense().enemyDistance <= instr->arg);
+                break;
+            case BT_ENEMY_IS_TYPE:
+                status = (sense().enemy >= 0) && (units->type[sense().enemy] == instr->arg);
+                break;
+
+            case BT_ATTACK_NEAREST:
+            case BT_ATTACK_WEAKEST:
+            case BT_ATTACK_TYPE:
+            {
+                int target = SelectBehaviorTarget(units, lineOfSight, u, instr->op, instr->arg);
+                status = (target >= 0);
+                if (status) decision = BehaviorDecision{ BEHAVIOR_ATTACK, target };
+            } break;
+
+            case BT_ADVANCE:
+                status = (sense().enemy >= 0);
+                if (status) decision = BehaviorDecision{ BEHAVIOR_ADVANCE, sense().enemy };
+                break;
+            case BT_SCOUT:
+                status = (sense().enemy < 0);
+                if (status) decision = BehaviorDecision{ BEHAVIOR_SCOUT, -1 };
+                break;
+            case BT_HOLD:
+                status = true;
+                decision = BehaviorDecision{ BEHAVIOR_HOLD, -1 };
+                break;
+            default: return decision;
+        }
+    }
+}
+
+#if defined(BATTLE_BENCHMARK)
+void RunBehaviorBenchmark(void);
+#endif
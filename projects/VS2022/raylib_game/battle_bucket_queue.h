@@ -0,0 +1,75 @@
+﻿/**********************************************************************************************
+*   Bucket queue (Dial's algorithm)
+*
+*   key 為小整數的優先佇列: 每個 key 一個 bucket (linked list), 取出時從目前最小 key 往上找
+*   Dijkstra 的邊權重最多 TERRAIN_MAX_COST, 佇列中的 key 一定落在 [current, current + 最大權重],
+*   所以 bucket 只要繞圈使用 BUCKET_QUEUE_SLOTS 個; push / pop 都是 O(1), 接近純 BFS 的速度
+*
+*   entry 不重複使用 (lazy deletion, 取出後由呼叫端略過過期的), maxEntries 要涵蓋一次搜尋的總 push 數:
+*   4 方向 Dijkstra 每格只在第一次 (有效) 取出時推鄰居, 總數不超過 1 + 4*格子數; 超過是呼叫端的 bug (assert)
+**********************************************************************************************/
+
+#pragma once
+#include <vector>
+#include <assert.h>
+#include "battle_terrain.h"
+
+#define BUCKET_QUEUE_SLOTS  16      // 2 的次方, 需大於最大邊權重
+
+static_assert((BUCKET_QUEUE_SLOTS & (BUCKET_QUEUE_SLOTS - 1)) == 0, "bucket count must be a power of two");
+static_assert(BUCKET_QUEUE_SLOTS > TERRAIN_MAX_COST, "buckets must cover the largest edge cost");
+
+typedef struct BucketQueue {
+    int head[BUCKET_QUEUE_SLOTS];
+    std::vector<int> next;
+    std::vector<int> key;
+    std::vector<int> value;
+    int entryCount;
+    int count;
+    int current;                    // 目前最小 key
+} BucketQueue;
+
+inline void ClearBucketQueue(BucketQueue *queue)
+{
+    for (int i = 0; i < BUCKET_QUEUE_SLOTS; i++) queue->head[i] = -1;
+    queue->entryCount = 0;
+    queue->count = 0;
+    queue->current = 0;
+}
+
+inline void InitBucketQueue(BucketQueue *queue, int maxEntries)
+{
+    queue->next.assign(maxEntries, -1);
+    queue->key.assign(maxEntries, 0);
+    queue->value.assign(maxEntries, 0);
+    ClearBucketQueue(queue);
+}
+
+inline void PushBucket(BucketQueue *queue, int key, int value)
+{
+    assert(queue->entryCount < (int)queue->next.size());
+    if (queue->count == 0) queue->current = key;
+
+    int e = queue->entryCount++;
+    int slot = key & (BUCKET_QUEUE_SLOTS - 1);
+    queue->key[e] = key;
+    queue->value[e] = value;
+    queue->next[e] = queue->head[slot];
+    queue->head[slot] = e;
+    queue->count++;
+}
+
+inline bool PopBucket(BucketQueue *queue, int *key, int *value)
+{
+    if (queue->count == 0) return false;
+
+    while (queue->head[queue->current & (BUCKET_QUEUE_SLOTS - 1)] < 0) queue->current++;
+
+    int slot = queue->current & (BUCKET_QUEUE_SLOTS - 1);
+    int e = queue->head[slot];
+    queue->head[slot] = queue->next[e];
+    queue->count--;
+    *key = queue->key[e];
+    *value = queue->value[e];
+    return true;
+}
@@ -0,0 +1,230 @@
+﻿/**********************************************************************************************
+*   Incremental path repair (D* Lite)
+**********************************************************************************************/
+
+#include "battle_dstar.h"
+#include <stdlib.h>
+
+static const int dstarDirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
+
+void InitDStarGraph(DStarGraph *graph, int width, int height)
+{
+    graph->width = width;
+    graph->height = height;
+    graph->cost.assign((size_t)width*height, 1);
+    graph->version = 0;
+}
+
+void SetDStarCellCost(DStarGraph *graph, int cell, int cost)
+{
+    if (graph->cost[cell] == cost) return;
+    graph->cost[cell] = cost;
+    graph->changeLog[graph->version%DSTAR_CHANGE_LOG] = cell;
+    graph->version++;
+}
+
+void InitDStarLite(DStarLite *plan, int cellCount)
+{
+    plan->owner = INVALID_UNIT_HANDLE;
+    plan->goal = -1;
+    plan->start = -1;
+    plan->km = 0;
+    plan->version = 0;
+    plan->g.assign(cellCount, DSTAR_INFINITY);
+    plan->rhs.assign(cellCount, DSTAR_INFINITY);
+    plan->heapCell.assign(cellCount, 0);
+    plan->heapKey.assign(cellCount, DStarKey{ 0, 0 });
+    plan->heapPos.assign(cellCount, -1);
+    plan->heapCount = 0;
+}
+
+//---------------------------------------------------------------------------
+// Indexed heap
+//---------------------------------------------------------------------------
+static bool KeyLess(DStarKey a, DStarKey b) { return (a.k1 != b.k1)? (a.k1 < b.k1) : (a.k2 < b.k2); }
+
+static void HeapPlace(DStarLite *plan, int i, int cell, DStarKey key)
+{
+    plan->heapCell[i] = cell;
+    plan->heapKey[i] = key;
+    plan->heapPos[cell] = i;
+}
+
+static void HeapSift(DStarLite *plan, int i)
+{
+    int cell = plan->heapCell[i];
+    DStarKey key = plan->heapKey[i];
+
+    while (i > 0)
+    {
+        int parent = (i - 1)/2;
+        if (!KeyLess(key, plan->heapKey[parent])) break;
+        HeapPlace(plan, i, plan->heapCell[parent], plan->heapKey[parent]);
+        i = parent;
+    }
+    while (true)
+    {
+        int child = 2*i + 1;
+        if (child >= plan->heapCount) break;
+        if ((child + 1 < plan->heapCount) && KeyLess(plan->heapKey[child + 1], plan->heapKey[child])) child++;
+        if (!KeyLess(plan->heapKey[child], key)) break;
+        HeapPlace(plan, i, plan->heapCell[child], plan->heapKey[child]);
+        i = child;
+    }
+    HeapPlace(plan, i, cell, key);
+}
+
+static void HeapSet(DStarLite *plan, int cell, DStarKey key)
+{
+    int i = plan->heapPos[cell];
+    if (i < 0) i = plan->heapCount++;
+    HeapPlace(plan, i, cell, key);
+    HeapSift(plan, i);
+}
+
+static void HeapRemove(DStarLite *plan, int cell)
+{
+    int i = plan->heapPos[cell];
+    if (i < 0) return;
+    plan->heapPos[cell] = -1;
+    int last = --plan->heapCount;
+    if (i == last) return;
+    HeapPlace(plan, i, plan->heapCell[last], plan->heapKey[last]);
+    HeapSift(plan, i);
+}
+
+//---------------------------------------------------------------------------
+// D* Lite
+//---------------------------------------------------------------------------
+// 曼哈頓距離 x 最低地形成本 (道路 = 1), 不會高估
+static int Heuristic(const DStarGraph *graph, int a, int b)
+{
+    return abs(a%graph->width - b%graph->width) + abs(a/graph->width - b/graph->width);
+}
+
+static DStarKey CalculateKey(const DStarLite *plan, const DStarGraph *graph, int cell)
+{
+    int m = (plan->g[cell] < plan->rhs[cell])? plan->g[cell] : plan->rhs[cell];
+    if (m >= DSTAR_INFINITY) return DStarKey{ DSTAR_INFINITY, DSTAR_INFINITY };
+    return DStarKey{ m + Heuristic(graph, plan->start, cell) + plan->km, m };
+}
+
+// 進入 cell 的成本; 目標格本身被敵人佔著, 但走到那裡就是終點
+static int EnterCost(const DStarLite *plan, const DStarGraph *graph, int cell)
+{
+    return (cell == plan->goal)? 1 : graph->cost[cell];
+}
+
+static void UpdateVertex(DStarLite *plan, const DStarGraph *graph, int cell)
+{
+    int width = graph->width;
+    if (cell != plan->goal)
+    {
+        int best = DSTAR_INFINITY;
+        int cx = cell%width, cy = cell/width;
+        for (int i = 0; i < 4; i++)
+        {
+            int nx = cx + dstarDirs[i][0];
+            int ny = cy + dstarDirs[i][1];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= graph->height) continue;
+            int next = ny*width + nx;
+            int c = EnterCost(plan, graph, next);
+            if ((c >= DSTAR_INFINITY) || (plan->g[next] >= DSTAR_INFINITY)) continue;
+            if (c + plan->g[next] < best) best = c + plan->g[next];
+        }
+        plan->rhs[cell] = best;
+    }
+
+    if (plan->g[cell] != plan->rhs[cell]) HeapSet(plan, cell, CalculateKey(plan, graph, cell));
+    else HeapRemove(plan, cell);
+}
+
+static void UpdateNeighbors(DStarLite *plan, const DStarGraph *graph, int cell)
+{
+    int width = graph->width;
+    int cx = cell%width, cy = cell/width;
+    for (int i = 0; i < 4; i++)
+    {
+        int nx = cx + dstarDirs[i][0];
+        int ny = cy + dstarDirs[i][1];
+        if (nx < 0 || nx >= width || ny < 0 || ny >= graph->height) continue;
+        UpdateVertex(plan, graph, ny*width + nx);
+    }
+}
+
+static int ComputeShortestPath(DStarLite *plan, const DStarGraph *graph, int margin)
+{
+    int expanded = 0;
+    int start = plan->start;
+
+    while (plan->heapCount > 0)
+    {
+        DStarKey limit = CalculateKey(plan, graph, start);
+        if (limit.k1 < DSTAR_INFINITY) limit.k1 += margin;
+        if (!KeyLess(plan->heapKey[0], limit) && (plan->rhs[start] <= plan->g[start])) break;
+
+        int cell = plan->heapCell[0];
+        DStarKey oldKey = plan->heapKey[0];
+        DStarKey newKey = CalculateKey(plan, graph, cell);
+        expanded++;
+
+        if (KeyLess(oldKey, newKey))
+        {
+            HeapSet(plan, cell, newKey);
+        }
+        else if (plan->g[cell] > plan->rhs[cell])
+        {
+            plan->g[cell] = plan->rhs[cell];
+            HeapRemove(plan, cell);
+            UpdateNeighbors(plan, graph, cell);
+        }
+        else
+        {
+            plan->g[cell] = DSTAR_INFINITY;
+            UpdateVertex(plan, graph, cell);
+            UpdateNeighbors(plan, graph, cell);
+        }
+    }
+    return expanded;
+}
+
+static void ResetDStarLite(DStarLite *plan, const DStarGraph *graph, UnitHandle owner, int start, int goal)
+{
+    for (int i = 0; i < plan->heapCount; i++) plan->heapPos[plan->heapCell[i]] = -1;
+    plan->heapCount = 0;
+    for (size_t c = 0; c < plan->g.size(); c++)
+    {
+        plan->g[c] = DSTAR_INFINITY;
+        plan->rhs[c] = DSTAR_INFINITY;
+    }
+
+    plan->owner = owner;
+    plan->goal = goal;
+    plan->start = start;
+    plan->km = 0;
+    plan->version = graph->version;
+    plan->rhs[goal] = 0;
+    HeapSet(plan, goal, CalculateKey(plan, graph, goal));
+}
+
+int UpdateDStarLite(DStarLite *plan, const DStarGraph *graph, UnitHandle owner, int start, int goal, int margin)
+{
+    bool rebuild = (plan->owner != owner) || (plan->goal != goal) || (graph->version - plan->version > DSTAR_CHANGE_LOG);
+
+    if (rebuild)
+    {
+        ResetDStarLite(plan, graph, owner, start, goal);
+    }
+    else
+    {
+        // 起點移動: 之後算出的 key 都多了這段距離, 以 km 補上而不重排 heap
+        plan->km += Heuristic(graph, plan->start, start);
+        plan->start = start;
+
+        // 只修補成本改變的格子: 進入 cell 的邊變了, 影響的是 cell 的鄰居
+        for (unsigned int v = plan->version; v != graph->version; v++) UpdateNeighbors(plan, graph, graph->changeLog[v%DSTAR_CHANGE_LOG]);
+        plan->version = graph->version;
+    }
+
+    return ComputeShortestPath(plan, graph, margin);
+}
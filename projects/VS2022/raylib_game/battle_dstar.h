@@ -0,0 +1,64 @@
+﻿/**********************************************************************************************
+*   Incremental path repair (D* Lite, Koenig & Likhachev 2002)
+*
+*   DStarGraph 是所有單位共用的格子成本 (地形), 每次成本改變都記在 change log,
+*   附上遞增的版本號; 每個單位各自有一份 DStarLite 計畫 (從目標往回搜尋), 下次規劃時只把
+*   「上次之後改變的格子」套用進來再修補, 工作量跟改變的量成正比, 而不是跟棋盤大小
+*
+*   計畫必須重建的情況: 目標格改變、落後太多版本 (change log 已被覆蓋)、slot 換了主人
+*   起點 (單位自己) 移動不用重建, 以 km 修正 key 即可; 目標只移動一點時的沿用方式見 battle_path.h
+*   單位佔位不進 DStarGraph (每次行動都會變, 修補量跟重建差不多), 由 cooperative A* 自己加上懲罰
+**********************************************************************************************/
+
+#pragma once
+#include <vector>
+#include "battle_units.h"
+
+#define DSTAR_INFINITY              0x3fffffff
+#define DSTAR_CHANGE_LOG            256     // 保留最近幾筆成本變更
+
+typedef struct DStarGraph {
+    int width;
+    int height;
+    std::vector<int> cost;                  // 進入該格的成本 (>= 1), DSTAR_INFINITY = 牆
+    int changeLog[DSTAR_CHANGE_LOG];        // 第 v 次變更的格子放在 [v % DSTAR_CHANGE_LOG]
+    unsigned int version;                   // 已記錄的變更數
+} DStarGraph;
+
+typedef struct DStarKey {
+    int k1;
+    int k2;
+} DStarKey;
+
+typedef struct DStarLite {
+    UnitHandle owner;
+    int goal;                               // 搜尋起點 (目標格), -1 = 尚未建立
+    int start;                              // 單位目前所在格
+    int km;
+    unsigned int version;                   // 已套用到的 DStarGraph 版本
+
+    std::vector<int> g;
+    std::vector<int> rhs;
+
+    // indexed binary heap: heapCell[i] 與 heapKey[i] 一起移動, heapPos[cell] = 位置或 -1
+    std::vector<int> heapCell;
+    std::vector<DStarKey> heapKey;
+    std::vector<int> heapPos;
+    int heapCount;
+} DStarLite;
+
+void InitDStarGraph(DStarGraph *graph, int width, int height);
+void SetDStarCellCost(DStarGraph *graph, int cell, int cost);     // 成本有變才記錄
+
+void InitDStarLite(DStarLite *plan, int cellCount);
+
+// 讓 plan 對應 (owner, start -> goal) 並修補到最新, 回傳展開的節點數
+// margin: 除了 start 之外, key 比 start 多 margin 以內的格子也算到一致, 讓起點附近的格子都有正確成本
+int UpdateDStarLite(DStarLite *plan, const DStarGraph *graph, UnitHandle owner, int start, int goal, int margin);
+
+// 到目標的成本 (已算過的格子), 沒算到或到不了回傳 -1
+inline int GetDStarDistance(const DStarLite *plan, int cell)
+{
+    int d = (plan->g[cell] < plan->rhs[cell])? plan->g[cell] : plan->rhs[cell];
+    return (d >= DSTAR_INFINITY)? -1 : d;
+}
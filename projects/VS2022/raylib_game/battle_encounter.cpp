@@ -0,0 +1,181 @@
+﻿/**********************************************************************************************
+*   Battle encounters (seeded generation + headless pre-simulation)
+**********************************************************************************************/
+
+#include "battle_encounter.h"
+#include "battle_setup_sim.h"
+#include "battle_terrain.h"
+
+static const int cellCount = ENCOUNTER_GRID_WIDTH*ENCOUNTER_GRID_HEIGHT;
+
+static Encounter handedOff;             // GAME_MAP -> GAMEPLAY 交接, 都在主執行緒
+static bool handedOffValid = false;
+
+static unsigned int NextEncounterRandom(unsigned int *state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// [0, n)
+static int GetEncounterRandom(unsigned int *state, int n) { return (int)(NextEncounterRandom(state)%(unsigned int)n); }
+
+// 左上角走得到右下角 (只有牆擋路)
+static bool IsEncounterConnected(const int *grid)
+{
+    int queue[cellCount];
+    bool visited[cellCount] = { false };
+    int head = 0, tail = 0;
+    queue[tail++] = 0;
+    visited[0] = true;
+
+    static const int dirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
+    while (head < tail)
+    {
+        int cur = queue[head++];
+        if (cur == cellCount - 1) return true;
+        int cx = cur%ENCOUNTER_GRID_WIDTH, cy = cur/ENCOUNTER_GRID_WIDTH;
+        for (int i = 0; i < 4; i++)
+        {
+            int nx = cx + dirs[i][0];
+            int ny = cy + dirs[i][1];
+            if (nx < 0 || nx >= ENCOUNTER_GRID_WIDTH || ny < 0 || ny >= ENCOUNTER_GRID_HEIGHT) continue;
+            int next = ny*ENCOUNTER_GRID_WIDTH + nx;
+            if (visited[next] || !IsTerrainWalkable(grid[next])) continue;
+            visited[next] = true;
+            queue[tail++] = next;
+        }
+    }
+    return false;
+}
+
+static void GenerateEncounterGrid(Encounter *encounter, unsigned int *rng)
+{
+    int *grid = encounter->grid;
+    do
+    {
+        for (int y = 0; y < ENCOUNTER_GRID_HEIGHT; y++)
+        {
+            for (int x = 0; x < ENCOUNTER_GRID_WIDTH; x++)
+            {
+                int *cell = &grid[y*ENCOUNTER_GRID_WIDTH + x];
+
+                // 避免出生區域被障礙物封死
+                if ((y < 3) || (y > ENCOUNTER_GRID_HEIGHT - 4)) { *cell = TERRAIN_FLOOR; continue; }
+
+                // 隨機生成障礙物 (20% 機率), 泥地 (8%), 高地 (6%)
+                int r = GetEncounterRandom(rng, 101);
+                if (r < 20) *cell = TERRAIN_WALL;
+                else if (r < 28) *cell = TERRAIN_MUD;
+                else if (r < 34) *cell = TERRAIN_HIGH_GROUND;
+                else *cell = TERRAIN_FLOOR;
+            }
+        }
+
+        // 一條縱貫棋盤的道路, 遇到障礙就斷開
+        int roadX = GetEncounterRandom(rng, ENCOUNTER_GRID_WIDTH);
+        for (int y = 0; y < ENCOUNTER_GRID_HEIGHT; y++)
+            if (grid[y*ENCOUNTER_GRID_WIDTH + roadX] != TERRAIN_WALL) grid[y*ENCOUNTER_GRID_WIDTH + roadX] = TERRAIN_ROAD;
+    }
+    while (!IsEncounterConnected(grid));
+}
+
+// 紅隊在上方 4 列、藍隊在下方 4 列, 兵種隨機
+static void GenerateEncounterUnits(Encounter *encounter, unsigned int *rng)
+{
+    UnitStore *units = &encounter->units;
+    InitUnitStore(units);
+
+    for (int i = 0; i < ENCOUNTER_TEAM_UNITS; i++)
+    {
+        for (int t = 0; t < TEAM_COUNT; t++)
+        {
+            int x, y;
+            do {
+                x = GetEncounterRandom(rng, ENCOUNTER_GRID_WIDTH);
+                y = GetEncounterRandom(rng, 4);
+                if (t == TEAM_BLUE) y = ENCOUNTER_GRID_HEIGHT - 1 - y;
+            } while (!IsTerrainWalkable(encounter->grid[y*ENCOUNTER_GRID_WIDTH + x]) || (FindUnitAt(units, x, y) >= 0));
+
+            AddCatalogUnit(units, (Team)t, x, y, GetEncounterRandom(rng, GameData::UNIT_TYPE_COUNT), 1);
+        }
+    }
+}
+
+void GenerateEncounter(unsigned int seed, Encounter *out)
+{
+    unsigned int rng = (seed != 0)? seed : 1;
+    out->seed = seed;
+    GenerateEncounterGrid(out, &rng);
+    GenerateEncounterUnits(out, &rng);
+}
+
+void HandOffEncounter(const Encounter *encounter)
+{
+    handedOff = *encounter;
+    handedOffValid = true;
+}
+
+bool TakeHandedOffEncounter(Encounter *out)
+{
+    if (!handedOffValid) return false;
+    *out = handedOff;
+    handedOffValid = false;
+    return true;
+}
+
+bool SimulateEncounter(const Encounter *encounter, int firstSeed, int count, EncounterSummary *summary,
+    const std::atomic<unsigned int> *generation, unsigned int expected)
+{
+    LineOfSightTable lineOfSight;
+    BuildLineOfSightTable(&lineOfSight, encounter->grid, ENCOUNTER_GRID_WIDTH, ENCOUNTER_GRID_HEIGHT);
+
+    EncounterSummary result = *summary;
+    SetupBattle battle;
+    for (int s = firstSeed; s < firstSeed + count; s++)
+    {
+        StartSetupBattle(&battle, &encounter->units, &lineOfSight, encounter->grid, ENCOUNTER_GRID_WIDTH, ENCOUNTER_GRID_HEIGHT, (unsigned int)s + 1);
+        for (int turn = 1; turn <= ENCOUNTER_PRESIM_MAX_TURNS; turn++)
+        {
+            if ((generation != NULL) && (generation->load(std::memory_order_relaxed) != expected)) return false;
+            if (StepSetupBattle(&battle, turn*SCHEDULER_TICKS_PER_TURN)) break;
+        }
+
+        result.runs++;
+        result.blueLosses += encounter->units.count[TEAM_BLUE] - battle.units.count[TEAM_BLUE];
+        if (battle.over)
+        {
+            result.finished++;
+            result.totalTicks += battle.endTime;
+            if (battle.winner == TEAM_BLUE) result.blueWins++;
+        }
+        else
+        {
+            // 打不完: 同 GAMEPLAY 的僵局判定, 總 hp 高的一方獲勝 (相同算藍隊)
+            int alive;
+            Fixed redHP, blueHP;
+            GetUnitTeamStats(&battle.units, TEAM_RED, &alive, &redHP);
+            GetUnitTeamStats(&battle.units, TEAM_BLUE, &alive, &blueHP);
+            if (blueHP >= redHP) result.blueWins++;
+        }
+    }
+    *summary = result;
+    return true;
+}
+
+int GetEncounterDifficulty(const EncounterSummary *summary)
+{
+    if (summary->runs == 0) return 1;
+    int winRate = summary->blueWins*100/summary->runs;
+    return (winRate >= 70)? 0 : (winRate >= 40)? 1 : 2;
+}
+
+const char *GetEncounterDifficultyName(int difficulty)
+{
+    static const char *names[3] = { "Easy", "Fair", "Hard" };
+    return names[difficulty];
+}
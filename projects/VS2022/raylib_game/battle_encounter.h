@@ -0,0 +1,54 @@
+﻿/**********************************************************************************************
+*   Battle encounters (seeded generation + headless pre-simulation)
+*
+*   一場 GAMEPLAY 戰鬥的開場 (地形 + 雙方單位) 只由 seed 決定, 用自己的亂數狀態產生,
+*   不碰 GetRandomValue / rand(), 可以在背景執行緒先做好
+*
+*   SimulateEncounter 以 battle_setup_sim.h 的簡化規則 (兵種的 behavior tree, 往最近的敵人直走, 被牆擋住才繞路)
+*   換不同先攻順序多打幾場, 統計藍隊 (玩家) 勝率、陣亡數與回合數, 當作難度的估計;
+*   GAMEPLAY 實際的 AI (合作尋路、視野) 比這個聰明, 所以只是相對難度
+*
+*   GAME_MAP 選定節點後用 HandOffEncounter 把該節點的戰鬥交給接著開場的 GAMEPLAY,
+*   GAMEPLAY 在 Init 取走 (只取一次), 沒有交接時才自己用新的 seed 產生
+**********************************************************************************************/
+
+#pragma once
+#include "battle_units.h"
+#include "battle_scheduler.h"
+#include <atomic>
+
+#define ENCOUNTER_GRID_WIDTH        8
+#define ENCOUNTER_GRID_HEIGHT       16
+#define ENCOUNTER_TEAM_UNITS        16
+#define ENCOUNTER_PRESIM_SEEDS      32
+#define ENCOUNTER_PRESIM_MAX_TURNS  150     // 打不完時依總 hp 決定勝負
+
+typedef struct Encounter {
+    unsigned int seed;
+    int grid[ENCOUNTER_GRID_HEIGHT*ENCOUNTER_GRID_WIDTH];   // TERRAIN_*
+    UnitStore units;
+} Encounter;
+
+// 累計值, 可以分好幾次 SimulateEncounter 加進去
+typedef struct EncounterSummary {
+    int runs;
+    int blueWins;
+    int blueLosses;                 // 所有場次的藍隊陣亡數總和
+    int finished;                   // 分出勝負的場數
+    long long totalTicks;           // finished 場次的結束時間總和
+} EncounterSummary;
+
+void GenerateEncounter(unsigned int seed, Encounter *out);
+
+// 只在切換到 GAMEPLAY 之前呼叫; 取走後清空, 舊的交接不會留給之後別的流程開的戰鬥
+void HandOffEncounter(const Encounter *encounter);
+bool TakeHandedOffEncounter(Encounter *out);
+
+// 以先攻 seed [firstSeed, firstSeed + count) 各打一場, 結果累加進 summary
+// generation 非 NULL 時每回合比對, 不等於 expected 就放棄並回傳 false (summary 不變)
+bool SimulateEncounter(const Encounter *encounter, int firstSeed, int count, EncounterSummary *summary,
+    const std::atomic<unsigned int> *generation, unsigned int expected);
+
+// 0 = 簡單, 1 = 普通, 2 = 困難 (依藍隊勝率)
+int GetEncounterDifficulty(const EncounterSummary *summary);
+const char *GetEncounterDifficultyName(int difficulty);
@@ -0,0 +1,210 @@
+﻿/**********************************************************************************************
+*   Policy-templated battle engine
+*
+*   SETUP 與 GAMEPLAY 共用的行動流程:
+*       取出到期的行動 -> 感知 -> 兵種的 behavior tree -> 攻擊 / 移動 -> 排入下一次行動 -> 檢查勝負
+*   開場順序、找敵人與出手、移動方式由三個 policy 決定, 在編譯時組合成 BattleEngine<TurnOrder, Targeting, Movement>;
+*   policy 都是只有 static inline 函式的 struct, 每種組合各自展開, 執行時沒有任何 dispatch
+*
+*   State 需要的欄位 (BattleState 或同名欄位的 struct): units, scheduler, lineOfSight, over, winner, endTime;
+*   policy 自己要的資料 (亂數、尋路、視野...) 也放在 State 裡, 不用畫面的 static
+*   TurnOrder::ScheduleOpening(State*)                        排入每個單位的第一次行動
+*   Targeting::Perceive(const State*, u)                      -> BehaviorPerception (behavior tree 用到敵人資訊時才呼叫)
+*   Targeting::Strike(State*, u, target)                      扣血, 陣亡時 CompactUnits (只會動到 target 那一隊)
+*   Targeting::EndAction(State*)                              每次行動後更新快取 (例如視野)
+*   Movement::Stay(State*, u, now, interval)                  攻擊 / 待命 / 開場時留在原地
+*   Movement::Advance(State*, u, enemy, now, interval)
+*   Movement::Scout(State*, u, now, interval)
+*   Movement::EndAction(State*)                               每次行動後更新快取 (例如尋路成本)
+*
+*   這裡放兩邊都能用的 policy; 依賴畫面自己資料 (尋路、視野) 的 policy 放在各自的檔案
+*   SETUP 與 GAMEPLAY 的移動方式刻意不同, 理由見 battle_setup_sim.cpp 的 DirectStepMovement
+**********************************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <stdlib.h>
+#include "battle_units.h"
+#include "battle_scheduler.h"
+#include "battle_los.h"
+#include "battle_behavior.h"
+
+typedef struct BattleState {
+    UnitStore units;
+    ActionScheduler scheduler;
+    const LineOfSightTable *lineOfSight;
+    bool over;
+    Team winner;
+    int endTime;                        // 分出勝負的 tick
+} BattleState;
+
+template <typename TurnOrder, typename Targeting, typename Movement>
+struct BattleEngine
+{
+    template <typename State>
+    static void Start(State *state)
+    {
+        state->over = false;
+        state->winner = TEAM_RED;
+        state->endTime = 0;
+        InitActionScheduler(&state->scheduler);
+        TurnOrder::ScheduleOpening(state);
+
+        // 每個單位都先在原地待到第一次行動
+        for (int k = 0; k < state->scheduler.count; k++)
+        {
+            const ScheduledAction *first = &state->scheduler.heap[k];
+            Movement::Stay(state, GetUnitIndex(&state->units, first->unit), 0, first->time);
+        }
+    }
+
+    // 取出下一個 time <= untilTime 且單位還活著的行動; 沒有或戰鬥已結束回傳 false
+    template <typename State>
+    static bool Pop(State *state, int untilTime, ScheduledAction *out)
+    {
+        while (!state->over && PopDueAction(&state->scheduler, untilTime, out))
+            if (GetUnitIndex(&state->units, out->unit) >= 0) return true;     // 已陣亡的事件直接丟棄
+        return false;
+    }
+
+    template <typename State>
+    static BehaviorDecision Decide(const State *state, int u)
+    {
+        return RunBehavior(&state->units, state->lineOfSight, u, [state](int unit) { return Targeting::Perceive(state, unit); });
+    }
+
+    template <typename State>
+    static void Act(State *state, int u, BehaviorDecision decision, int now, int interval)
+    {
+        switch (decision.command)
+        {
+            case BEHAVIOR_ATTACK:
+                Targeting::Strike(state, u, decision.target);
+                Movement::Stay(state, u, now, interval);
+                break;
+            case BEHAVIOR_ADVANCE: Movement::Advance(state, u, decision.target, now, interval); break;
+            case BEHAVIOR_SCOUT: Movement::Scout(state, u, now, interval); break;
+            default: Movement::Stay(state, u, now, interval); break;
+        }
+    }
+
+    // 行動之後: 更新 policy 的快取, 排入這個單位的下一次行動, 檢查勝負
+    template <typename State>
+    static void Finish(State *state, const ScheduledAction *action, int interval)
+    {
+        Movement::EndAction(state);
+        Targeting::EndAction(state);
+        ScheduleAction(&state->scheduler, action->unit, action->time + interval);
+
+        bool redAlive = state->units.count[TEAM_RED] > 0;
+        bool blueAlive = state->units.count[TEAM_BLUE] > 0;
+        if (!redAlive || !blueAlive)
+        {
+            state->over = true;
+            state->winner = redAlive? TEAM_RED : TEAM_BLUE;
+            state->endTime = action->time;
+        }
+    }
+
+    // 依兵種的 behavior tree 執行 Pop 取出的行動
+    template <typename State>
+    static void Resolve(State *state, const ScheduledAction *action)
+    {
+        int u = GetUnitIndex(&state->units, action->unit);
+        int interval = GetActionInterval(state->units.speed[u]);
+        Act(state, u, Decide(state, u), action->time, interval);
+        Finish(state, action, interval);
+    }
+
+    // 執行所有 time <= untilTime 的行動, 回傳戰鬥是否已結束
+    template <typename State>
+    static bool Step(State *state, int untilTime)
+    {
+        ScheduledAction action;
+        while (Pop(state, untilTime, &action)) Resolve(state, &action);
+        return state->over;
+    }
+};
+
+//----------------------------------------------------------------------------------
+// 開場順序
+//----------------------------------------------------------------------------------
+
+// 每個單位第一次行動落在第一個行動間隔內的隨機 tick (State 需要 xorshift32 的 rng 欄位, Start 之前設好, 不可為 0)
+// 紅隊先、藍隊後依 dense 順序排入; 同一 tick 仍依這個順序行動
+struct SeededInitiative
+{
+    template <typename State>
+    static void ScheduleOpening(State *state)
+    {
+        for (int t = 0; t < TEAM_COUNT; t++)
+        {
+            for (int u = GetTeamBegin((Team)t); u < GetTeamEnd(&state->units, (Team)t); u++)
+            {
+                unsigned int x = state->rng;
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                state->rng = x;
+                int interval = GetActionInterval(state->units.speed[u]);
+                ScheduleAction(&state->scheduler, state->units.handle[u], 1 + (int)(x%(unsigned int)interval));
+            }
+        }
+    }
+};
+
+// 第一次行動都在一個行動間隔之後, 同時間依陣形順序: 藍隊在紅隊前, 藍隊 y 小的先, 紅隊 y 大的先 (不用亂數)
+struct FormationInitiative
+{
+    template <typename State>
+    static void ScheduleOpening(State *state)
+    {
+        const UnitStore *units = &state->units;
+        int order[MAX_BATTLE_UNITS];
+        int orderCount = 0;
+        for (int t = 0; t < TEAM_COUNT; t++)
+            for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(units, (Team)t); i++) order[orderCount++] = i;
+
+        std::sort(order, order + orderCount, [units](int a, int b)
+        {
+            if (GetUnitTeam(a) != GetUnitTeam(b)) return GetUnitTeam(a) == TEAM_BLUE;
+            if (GetUnitTeam(a) == TEAM_BLUE) return units->y[a] < units->y[b];
+            return units->y[a] > units->y[b];
+        });
+
+        for (int k = 0; k < orderCount; k++)
+            ScheduleAction(&state->scheduler, units->handle[order[k]], GetActionInterval(units->speed[order[k]]));
+    }
+};
+
+//----------------------------------------------------------------------------------
+// 找敵人與出手
+//----------------------------------------------------------------------------------
+
+// 整個棋盤都看得到: 曼哈頓距離最近的敵人 (同距離取 dense index 小的)
+struct FullVisionTargeting
+{
+    template <typename State>
+    static BehaviorPerception Perceive(const State *state, int u)
+    {
+        const UnitStore *units = &state->units;
+        BehaviorPerception perception = { -1, 0 };
+        Team enemyTeam = GetEnemyTeam(GetUnitTeam(u));
+        for (int e = GetTeamBegin(enemyTeam); e < GetTeamEnd(units, enemyTeam); e++)
+        {
+            int d = abs(units->x[u] - units->x[e]) + abs(units->y[u] - units->y[e]);
+            if ((perception.enemy < 0) || (d < perception.enemyDistance)) perception = BehaviorPerception{ e, d };
+        }
+        return perception;
+    }
+
+    template <typename State>
+    static void Strike(State *state, int u, int target)
+    {
+        state->units.hp[target] -= state->units.attack[u];
+        if (state->units.hp[target] <= 0) CompactUnits(&state->units);
+    }
+
+    template <typename State>
+    static void EndAction(State *) { }
+};
@@ -0,0 +1,33 @@
+﻿/**********************************************************************************************
+*   Fixed-point combat numbers
+*
+*   戰鬥結算用的 hp / 攻擊力都是 Fixed (Q16.16, 存在 int32_t): 扣血就是整數減法,
+*   Windows / Linux / WASM 算出來的結果逐 bit 相同, 加總、扣血的迴圈也能直接用整數 SIMD 向量化
+*
+*   兵種資料表 (game_unit.h) 的 float 只在編譯期 (constexpr) 轉成 Fixed, 執行時的戰鬥不碰 float;
+*   會影響單位怎麼走的影響圖 (battle_influence.h) 也是 Fixed, FixedToFloat 只給畫面顯示用
+**********************************************************************************************/
+
+#pragma once
+#include <stdint.h>
+
+typedef int32_t Fixed;
+
+#define FIXED_SHIFT     16
+#define FIXED_ONE       ((Fixed)1 << FIXED_SHIFT)
+
+constexpr Fixed IntToFixed(int value) { return (Fixed)(value*FIXED_ONE); }
+
+// 四捨五入到最接近的 1/65536; 只在 constexpr 資料表裡使用, 讓轉換發生在編譯期
+constexpr Fixed FloatToFixed(float value) { return (Fixed)((value >= 0.0f)? value*FIXED_ONE + 0.5f : value*FIXED_ONE - 0.5f); }
+
+// 四捨五入成整數 (value >= 0), 用於速度、射程這種只能是整數格 / 次數的數值
+constexpr int FixedRoundToInt(Fixed value) { return (int)((value + FIXED_ONE/2)/FIXED_ONE); }
+
+// 無條件進位, 顯示 hp 用: 剩 0.5 的單位還活著, 要顯示 1
+constexpr int FixedCeilToInt(Fixed value) { return (value > 0)? (int)((value + FIXED_ONE - 1)/FIXED_ONE) : (int)(value/FIXED_ONE); }
+
+// 兩個 Fixed 相乘, 中間用 64 位元避免溢位; 結果往負無限大捨去 (算術右移)
+inline Fixed FixedMul(Fixed a, Fixed b) { return (Fixed)(((int64_t)a*b) >> FIXED_SHIFT); }
+
+inline float FixedToFloat(Fixed value) { return (float)value*(1.0f/FIXED_ONE); }
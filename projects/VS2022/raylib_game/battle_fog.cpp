@@ -0,0 +1,182 @@
+﻿/**********************************************************************************************
+*   Battle fog of war (shadowcasting)
+**********************************************************************************************/
+
+#include "battle_fog.h"
+#include "battle_terrain.h"
+#include "raylib.h"
+
+// 每個 octant 把 (dx, dy) 轉成棋盤上的位移: x = dx*xx + dy*xy, y = dx*yx + dy*yy
+static const int octants[8][4] = {
+    {  1,  0,  0,  1 }, {  0,  1,  1,  0 }, {  0, -1,  1,  0 }, { -1,  0,  0,  1 },
+    { -1,  0,  0, -1 }, {  0, -1, -1,  0 }, {  0,  1, -1,  0 }, {  1,  0,  0, -1 },
+};
+
+typedef struct ShadowCaster {
+    CellMask *visible;
+    const int *walls;
+    int width;
+    int height;
+    int x;
+    int y;
+    int radius;
+} ShadowCaster;
+
+// 掃描 octant 的第 row 列起, 斜率在 [endSlope, startSlope] 之間的部分
+// 遇到牆就把牆前面還亮著的範圍遞迴到下一列, 牆後面的斜率範圍留給同一列繼續掃
+static void CastLight(const ShadowCaster *caster, int row, float startSlope, float endSlope, const int *m)
+{
+    if (startSlope < endSlope) return;
+
+    int radius2 = caster->radius*caster->radius;
+    float nextStart = startSlope;
+    for (int i = row; i <= caster->radius; i++)
+    {
+        bool blocked = false;
+        int dy = -i;
+        for (int dx = -i; dx <= 0; dx++)
+        {
+            float leftSlope = (dx - 0.5f)/(dy + 0.5f);
+            float rightSlope = (dx + 0.5f)/(dy - 0.5f);
+            if (startSlope < rightSlope) continue;
+            if (endSlope > leftSlope) break;
+
+            int cx = caster->x + dx*m[0] + dy*m[1];
+            int cy = caster->y + dx*m[2] + dy*m[3];
+            if (cx < 0 || cx >= caster->width || cy < 0 || cy >= caster->height) continue;
+
+            int cell = cy*caster->width + cx;
+            if (dx*dx + dy*dy <= radius2) SetCellMaskBit(caster->visible, cell);
+
+            bool wall = (caster->walls[cell] == TERRAIN_WALL);
+            if (blocked)
+            {
+                if (wall) { nextStart = rightSlope; continue; }
+                blocked = false;
+                startSlope = nextStart;
+            }
+            else if (wall && (i < caster->radius))
+            {
+                blocked = true;
+                CastLight(caster, i + 1, startSlope, leftSlope, m);
+                nextStart = rightSlope;
+            }
+        }
+        if (blocked) break;
+    }
+}
+
+void CastShadows(CellMask *visible, const int *walls, int width, int height, int x, int y, int radius)
+{
+    ClearCellMask(visible);
+    SetCellMaskBit(visible, y*width + x);
+
+    ShadowCaster caster = { visible, walls, width, height, x, y, radius };
+    for (int o = 0; o < 8; o++) CastLight(&caster, 1, 1.0f, 0.0f, octants[o]);
+}
+
+void InitFogOfWar(FogOfWar *fog, const int *walls, int width, int height)
+{
+    fog->width = width;
+    fog->height = height;
+    fog->walls = walls;
+    for (int t = 0; t < TEAM_COUNT; t++) ClearCellMask(&fog->teamVisible[t]);
+    fog->castCount = 0;
+    InvalidateFogOfWar(fog);
+}
+
+void InvalidateFogOfWar(FogOfWar *fog)
+{
+    for (int s = 0; s < MAX_BATTLE_UNITS; s++)
+    {
+        fog->owner[s] = INVALID_UNIT_HANDLE;
+        fog->cell[s] = -1;
+    }
+}
+
+void UpdateFogOfWar(FogOfWar *fog, const UnitStore *store)
+{
+    int width = fog->width;
+    for (int t = 0; t < TEAM_COUNT; t++)
+    {
+        CellMask team;
+        ClearCellMask(&team);
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(store, (Team)t); i++)
+        {
+            UnitHandle handle = store->handle[i];
+            int slot = handle & 0xffff;
+            int cell = store->y[i]*width + store->x[i];
+            if ((fog->owner[slot] != handle) || (fog->cell[slot] != cell))
+            {
+                CastShadows(&fog->unitVisible[slot], fog->walls, width, fog->height, store->x[i], store->y[i], FOG_SIGHT_RADIUS);
+                fog->owner[slot] = handle;
+                fog->cell[slot] = cell;
+                fog->castCount++;
+            }
+            team = OrCellMask(&team, &fog->unitVisible[slot]);
+        }
+        fog->teamVisible[t] = team;
+    }
+}
+
+#if defined(BATTLE_BENCHMARK)
+// 8x16 棋盤站滿 MAX_BATTLE_UNITS 個單位, 每回合每個單位隨機嘗試走一步,
+// 比較 增量更新 與 每回合全部重算 的平均時間
+void RunFogBenchmark(void)
+{
+    const int width = 8;
+    const int height = 16;
+    const int turns = 2000;
+
+    static int walls[width*height];
+    for (int c = 0; c < width*height; c++) walls[c] = (GetRandomValue(0, 99) < 15)? TERRAIN_WALL : TERRAIN_FLOOR;
+
+    static UnitStore store;
+    InitUnitStore(&store);
+    for (int c = 0; (c < width*height) && (store.count[TEAM_RED] + store.count[TEAM_BLUE] < MAX_BATTLE_UNITS); c++)
+    {
+        if (walls[c] == TERRAIN_WALL) continue;
+        Team team = (c < width*height/2)? TEAM_RED : TEAM_BLUE;
+        if (store.count[team] < MAX_TEAM_UNITS) AddUnit(&store, team, c%width, c/width, IntToFixed(10), IntToFixed(3), 1, 1, 0);
+    }
+
+    static FogOfWar incremental;
+    static FogOfWar full;
+    InitFogOfWar(&incremental, walls, width, height);
+    InitFogOfWar(&full, walls, width, height);
+
+    static const int dirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
+    double incrementalTime = 0.0;
+    double fullTime = 0.0;
+    int moves = 0;
+    for (int k = 0; k < turns; k++)
+    {
+        for (int t = 0; t < TEAM_COUNT; t++)
+        {
+            for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(&store, (Team)t); i++)
+            {
+                const int *d = dirs[GetRandomValue(0, 3)];
+                int nx = store.x[i] + d[0], ny = store.y[i] + d[1];
+                if (nx < 0 || nx >= width || ny < 0 || ny >= height || walls[ny*width + nx] == TERRAIN_WALL) continue;
+                if (FindUnitAt(&store, nx, ny) >= 0) continue;
+                store.x[i] = nx;
+                store.y[i] = ny;
+                moves++;
+            }
+        }
+
+        double start = GetTime();
+        UpdateFogOfWar(&incremental, &store);
+        incrementalTime += GetTime() - start;
+
+        start = GetTime();
+        InvalidateFogOfWar(&full);
+        UpdateFogOfWar(&full, &store);
+        fullTime += GetTime() - start;
+    }
+
+    int unitCount = store.count[TEAM_RED] + store.count[TEAM_BLUE];
+    TraceLog(LOG_INFO, "BENCHMARK: fog of war %dx%d, %d units, %.1f moves per turn: incremental %.2f us (%d casts), full %.2f us (%d casts) per turn",
+        width, height, unitCount, (float)moves/turns, incrementalTime*1000000.0/turns, incremental.castCount, fullTime*1000000.0/turns, full.castCount);
+}
+#endif
@@ -0,0 +1,51 @@
+﻿/**********************************************************************************************
+*   Battle fog of war (shadowcasting)
+*
+*   每個單位以 recursive shadowcasting (8 個 octant) 算出視野, 寫成一張 CellMask bitboard;
+*   各隊的視野 = 該隊所有單位視野的 OR, 查詢某格是否看得到只是一次 bit 讀取
+*
+*   視野依 handle slot 快取, 記下算的時候站在哪一格; UpdateFogOfWar 只重算
+*   移動過、新出現 (slot 換了主人) 的單位, 其他單位直接沿用, 再把各隊的 mask OR 起來
+*   地形改變 (牆) 時呼叫 InvalidateFogOfWar, 下次更新全部重算
+*
+*   與 battle_los.h 相同, 棋盤最多 LOS_MAX_CELLS 格
+*   定義 BATTLE_BENCHMARK 時 RunFogBenchmark() 比較增量更新與每次全部重算的時間
+**********************************************************************************************/
+
+#pragma once
+#include "battle_units.h"
+#include "battle_los.h"
+
+#define FOG_SIGHT_RADIUS    5       // 視野半徑 (歐幾里得距離, 格), 不小於最大射程
+
+typedef struct FogOfWar {
+    int width;
+    int height;
+    const int *walls;                           // 同 grid[][], 只有 TERRAIN_WALL 會擋住視線
+
+    // 依 handle slot 快取的單位視野
+    UnitHandle owner[MAX_BATTLE_UNITS];         // 快取屬於哪個 handle, INVALID_UNIT_HANDLE = 無效
+    int cell[MAX_BATTLE_UNITS];                 // 算視野時所在的格子
+    CellMask unitVisible[MAX_BATTLE_UNITS];
+
+    CellMask teamVisible[TEAM_COUNT];
+    int castCount;                              // 累計 shadowcast 次數 (重算的單位數)
+} FogOfWar;
+
+void InitFogOfWar(FogOfWar *fog, const int *walls, int width, int height);
+void InvalidateFogOfWar(FogOfWar *fog);
+
+// 從 (x, y) 算出 radius 內看得到的格子 (含自己與擋住視線的牆)
+void CastShadows(CellMask *visible, const int *walls, int width, int height, int x, int y, int radius);
+
+// 只重算移動過的單位, 然後重建各隊視野
+void UpdateFogOfWar(FogOfWar *fog, const UnitStore *store);
+
+inline bool IsCellVisibleToTeam(const FogOfWar *fog, Team team, int cell)
+{
+    return GetCellMaskBit(&fog->teamVisible[team], cell);
+}
+
+#if defined(BATTLE_BENCHMARK)
+void RunFogBenchmark(void);
+#endif
@@ -0,0 +1,248 @@
+﻿/**********************************************************************************************
+*   Red team formation search
+**********************************************************************************************/
+
+#include "battle_formation.h"
+#include "battle_terrain.h"
+#include <chrono>
+
+#if !defined(FORMATION_SEARCH_THREADED)
+static SetupBattle searchBattle;
+static UnitStore searchStore;
+#endif
+
+static double GetSearchClock(void)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int NextFormationRandom(FormationIsland *island)
+{
+    unsigned int x = island->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    island->rng = x;
+    return x;
+}
+
+static int GetRedCount(const FormationSearchConfig *config) { return config->red.count[TEAM_RED]; }
+
+static bool IsFormationCellFree(const FormationSearchConfig *config, const Formation *formation, int count, int cell)
+{
+    if (!IsTerrainWalkable(config->walls[cell])) return false;
+    for (int i = 0; i < count; i++)
+        if (formation->cell[i] == cell) return false;
+    return true;
+}
+
+// 紅隊區域內隨機找一個空格, 找不到回傳 -1
+static int PickFreeFormationCell(const FormationSearchConfig *config, FormationIsland *island, const Formation *formation, int count)
+{
+    int zone = config->redRows*config->width;
+    int start = (int)(NextFormationRandom(island)%(unsigned int)zone);
+    for (int k = 0; k < zone; k++)
+    {
+        int cell = (start + k)%zone;
+        if (IsFormationCellFree(config, formation, count, cell)) return cell;
+    }
+    return -1;
+}
+
+static int64_t EvaluateFormation(const FormationSearchConfig *config, const Formation *formation, SetupBattle *battle, UnitStore *store)
+{
+    const UnitStore *red = &config->red;
+    int64_t score = 0;
+    for (int b = 0; b < config->blueSampleCount; b++)
+    {
+        *store = config->blueSamples[b];
+        for (int i = 0; i < GetRedCount(config); i++)
+        {
+            int r = GetTeamBegin(TEAM_RED) + i;
+            int cell = formation->cell[i];
+            AddUnit(store, TEAM_RED, cell%config->width, cell/config->width, red->hp[r], red->attack[r], red->speed[r], red->range[r], red->type[r]);
+        }
+
+        for (int s = 1; s <= FORMATION_SEEDS; s++)
+        {
+            StartSetupBattle(battle, store, config->lineOfSight, config->walls, config->width, config->height, config->seed + (unsigned int)s);
+            for (int turn = 1; turn <= FORMATION_MAX_TURNS; turn++)
+                if (StepSetupBattle(battle, turn*SCHEDULER_TICKS_PER_TURN)) break;
+
+            int alive;
+            Fixed redHP, blueHP;
+            GetUnitTeamStats(&battle->units, TEAM_RED, &alive, &redHP);
+            GetUnitTeamStats(&battle->units, TEAM_BLUE, &alive, &blueHP);
+            if (battle->over && (battle->winner == TEAM_RED)) score += IntToFixed(FORMATION_WIN_BONUS);
+            score += (int64_t)redHP - blueHP;
+        }
+    }
+    return score;
+}
+
+static void InitFormationIsland(FormationIsland *island, unsigned int seed)
+{
+    island->rng = (seed != 0)? seed : 1;
+    island->evaluations = 0;
+    island->populationSize = 0;
+}
+
+static const Formation *SelectFormationParent(FormationIsland *island)
+{
+    const Formation *a = &island->population[NextFormationRandom(island)%(unsigned int)island->populationSize];
+    const Formation *b = &island->population[NextFormationRandom(island)%(unsigned int)island->populationSize];
+    return (a->score >= b->score)? a : b;
+}
+
+// 產生一個子代並評分, 比族群最差的好就取代它
+static void EvolveFormationIsland(const FormationSearchConfig *config, FormationIsland *island, SetupBattle *battle, UnitStore *store)
+{
+    int count = GetRedCount(config);
+    const Formation *mother = SelectFormationParent(island);
+    const Formation *father = SelectFormationParent(island);
+
+    // 交配: 每個單位各自從父或母繼承位置, 撞到已用的格子就隨機換一格
+    Formation child;
+    for (int i = 0; i < count; i++)
+    {
+        int cell = (NextFormationRandom(island) & 1)? mother->cell[i] : father->cell[i];
+        child.cell[i] = IsFormationCellFree(config, &child, i, cell)? cell : PickFreeFormationCell(config, island, &child, i);
+    }
+
+    // 突變: 一個單位往旁邊挪一格, 或跳到紅隊區域的任意空格
+    int u = (int)(NextFormationRandom(island)%(unsigned int)count);
+    int old = child.cell[u];
+    child.cell[u] = -1;
+    int cell = -1;
+    if (NextFormationRandom(island) & 1)
+    {
+        static const int dirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
+        const int *d = dirs[NextFormationRandom(island) & 3];
+        int nx = old%config->width + d[0];
+        int ny = old/config->width + d[1];
+        if ((nx >= 0) && (nx < config->width) && (ny >= 0) && (ny < config->redRows)) cell = ny*config->width + nx;
+        if ((cell >= 0) && !IsFormationCellFree(config, &child, count, cell)) cell = -1;
+    }
+    else cell = PickFreeFormationCell(config, island, &child, count);
+    child.cell[u] = (cell >= 0)? cell : old;
+
+    child.score = EvaluateFormation(config, &child, battle, store);
+    island->evaluations++;
+
+    int worst = 0;
+    for (int p = 1; p < island->populationSize; p++)
+        if (island->population[p].score < island->population[worst].score) worst = p;
+    if (child.score > island->population[worst].score) island->population[worst] = child;
+}
+
+// 評分一個陣形: 族群還沒滿時加入一個隨機陣形, 滿了就演化一代
+static void StepFormationIsland(const FormationSearchConfig *config, FormationIsland *island, SetupBattle *battle, UnitStore *store)
+{
+    if (island->populationSize < FORMATION_POPULATION)
+    {
+        Formation *formation = &island->population[island->populationSize];
+        for (int i = 0; i < GetRedCount(config); i++) formation->cell[i] = PickFreeFormationCell(config, island, formation, i);
+        formation->score = EvaluateFormation(config, formation, battle, store);
+        island->evaluations++;
+        island->populationSize++;
+    }
+    else EvolveFormationIsland(config, island, battle, store);
+}
+
+static const Formation *GetBestIslandFormation(const FormationIsland *island)
+{
+    const Formation *best = &island->population[0];
+    for (int p = 1; p < island->populationSize; p++)
+        if (island->population[p].score > best->score) best = &island->population[p];
+    return best;
+}
+
+static void FinishFormationSearch(FormationSearch *search)
+{
+    search->best = *GetBestIslandFormation(&search->islands[0]);
+    for (int k = 1; k < search->islandCount; k++)
+    {
+        const Formation *best = GetBestIslandFormation(&search->islands[k]);
+        if (best->score > search->best.score) search->best = *best;
+    }
+    search->done = true;
+}
+
+#if defined(FORMATION_SEARCH_THREADED)
+static void RunFormationIsland(FormationSearch *search, int k, double deadline)
+{
+    SetupBattle battle;
+    UnitStore store;
+    FormationIsland *island = &search->islands[k];
+    InitFormationIsland(island, search->config.seed*(unsigned int)(k + 1) + 0x9e3779b9u);
+    do StepFormationIsland(&search->config, island, &battle, &store);
+    while (!search->cancel.load(std::memory_order_relaxed) && (GetSearchClock() < deadline));
+    search->running--;
+}
+#endif
+
+void StartFormationSearch(FormationSearch *search, const FormationSearchConfig *config)
+{
+    search->config = *config;
+    search->done = false;
+    search->cancel = false;
+    search->islandCount = 0;
+    search->best.score = 0;
+    for (int i = 0; i < MAX_TEAM_UNITS; i++) search->best.cell[i] = -1;
+
+    // 紅隊沒有單位或區域放不下: 不用搜尋
+    if ((GetRedCount(config) == 0) || (GetRedCount(config) > config->redRows*config->width))
+    {
+        search->done = true;
+        return;
+    }
+
+#if defined(FORMATION_SEARCH_THREADED)
+    // 留一個核心給主執行緒
+    int cores = (int)std::thread::hardware_concurrency();
+    search->islandCount = (cores > 2)? cores - 1 : 1;
+    if (search->islandCount > FORMATION_MAX_ISLANDS) search->islandCount = FORMATION_MAX_ISLANDS;
+
+    double deadline = GetSearchClock() + FORMATION_SEARCH_BUDGET;
+    search->running = search->islandCount;
+    search->workers.clear();
+    for (int k = 0; k < search->islandCount; k++) search->workers.emplace_back(RunFormationIsland, search, k, deadline);
+#else
+    search->islandCount = 1;
+    search->spent = 0.0;
+    double start = GetSearchClock();
+    InitFormationIsland(&search->islands[0], search->config.seed + 0x9e3779b9u);
+    StepFormationIsland(&search->config, &search->islands[0], &searchBattle, &searchStore);
+    search->spent += GetSearchClock() - start;
+#endif
+}
+
+bool UpdateFormationSearch(FormationSearch *search)
+{
+    if (search->done) return true;
+
+#if defined(FORMATION_SEARCH_THREADED)
+    if (search->running.load() > 0) return false;
+    for (size_t k = 0; k < search->workers.size(); k++) search->workers[k].join();
+    search->workers.clear();
+#else
+    double start = GetSearchClock();
+    while ((GetSearchClock() - start < FORMATION_FRAME_BUDGET) && (search->spent + GetSearchClock() - start < FORMATION_SEARCH_BUDGET))
+        StepFormationIsland(&search->config, &search->islands[0], &searchBattle, &searchStore);
+    search->spent += GetSearchClock() - start;
+    if (search->spent < FORMATION_SEARCH_BUDGET) return false;
+#endif
+
+    FinishFormationSearch(search);
+    return true;
+}
+
+void StopFormationSearch(FormationSearch *search)
+{
+    search->cancel = true;
+#if defined(FORMATION_SEARCH_THREADED)
+    for (size_t k = 0; k < search->workers.size(); k++) search->workers[k].join();
+    search->workers.clear();
+#endif
+    search->done = true;
+}
@@ -0,0 +1,85 @@
+﻿/**********************************************************************************************
+*   Red team formation search
+*
+*   在 y < redRows 的區域替紅隊挑陣形: 以 battle_setup_sim.h 的戰鬥當評分,
+*   對幾種「玩家可能的配置」(blueSamples) 各打 FORMATION_SEEDS 場,
+*   分數 = 紅隊剩餘血量 - 藍隊剩餘血量 + 勝場*FORMATION_WIN_BONUS
+*   (勝場加分不能太大, 否則只會挑到在少數樣本上僥倖贏一場的陣形)
+*   每個陣形都用同一組 blueSamples 與同一組先攻 seed (config->seed + s) 評分 (common random numbers),
+*   兩個陣形的分數差只來自陣形本身, 不會因為某個陣形剛好抽到好的先攻順序而勝出
+*
+*   演化方式是 steady-state: 每次從族群挑兩個 (tournament) 交配、突變出一個陣形,
+*   比族群最差的好就取代它; 每個執行緒各自演化一個族群 (island), 互不同步,
+*   時間到 (FORMATION_SEARCH_BUDGET) 再取所有 island 中最好的
+*   PLATFORM_WEB 沒有執行緒, 只有一個 island, 由 UpdateFormationSearch() 每幀跑一小段
+**********************************************************************************************/
+
+#pragma once
+#include "battle_setup_sim.h"
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#if !defined(PLATFORM_WEB)
+    #define FORMATION_SEARCH_THREADED
+    #include <thread>
+#endif
+
+#define FORMATION_BLUE_SAMPLES      16
+#define FORMATION_SEEDS             4           // 每種玩家配置打幾種先攻順序
+#define FORMATION_WIN_BONUS         20
+#define FORMATION_MAX_TURNS         100
+#define FORMATION_POPULATION        8           // 每個 island 在預算內只評分得了一百個左右的陣形, 族群小才有幾代可以演化
+#define FORMATION_MAX_ISLANDS       4
+#define FORMATION_SEARCH_BUDGET     0.25        // 秒
+#define FORMATION_FRAME_BUDGET      0.004       // 沒有執行緒時每幀最多花的時間 (秒)
+
+typedef struct FormationSearchConfig {
+    const LineOfSightTable *lineOfSight;
+    const int *walls;
+    int width;
+    int height;
+
+    UnitStore red;                              // 紅隊陣容 (只用數值, 位置由搜尋決定)
+    int redRows;                                // 紅隊只能放在 y < redRows
+    UnitStore blueSamples[FORMATION_BLUE_SAMPLES];  // 只含藍隊的假想配置
+    int blueSampleCount;
+    unsigned int seed;
+} FormationSearchConfig;
+
+typedef struct Formation {
+    int cell[MAX_TEAM_UNITS];                   // 第 i 個紅隊單位的格子 (y*width + x)
+    int64_t score;                              // 剩餘血量差 + 勝場加分 (Fixed 的原始值加總, 場數多時超過 32 位元)
+} Formation;
+
+typedef struct FormationIsland {
+    Formation population[FORMATION_POPULATION];
+    int populationSize;
+    unsigned int rng;
+    int evaluations;
+} FormationIsland;
+
+typedef struct FormationSearch {
+    FormationSearchConfig config;
+    FormationIsland islands[FORMATION_MAX_ISLANDS];
+    int islandCount;
+    Formation best;
+    bool done;
+
+    std::atomic<bool> cancel;
+#if defined(FORMATION_SEARCH_THREADED)
+    std::vector<std::thread> workers;
+    std::atomic<int> running;
+#else
+    double spent;                               // 已花掉的時間 (秒)
+#endif
+} FormationSearch;
+
+// config 整份複製進 search; lineOfSight / walls 在搜尋結束前必須有效
+void StartFormationSearch(FormationSearch *search, const FormationSearchConfig *config);
+
+// 每幀呼叫; 搜尋結束 (時間用完) 時回傳 true, 之後 search->best 就是結果
+bool UpdateFormationSearch(FormationSearch *search);
+
+// 中途放棄 (例如離開畫面), 等所有執行緒結束
+void StopFormationSearch(FormationSearch *search);
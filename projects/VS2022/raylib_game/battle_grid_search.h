@@ -0,0 +1,75 @@
+﻿/**********************************************************************************************
+*   Reusable grid BFS workspace
+*
+*   InitGridSearch 時依棋盤大小配置好所有暫存, 之後每次搜尋都不再配置記憶體:
+*       queue  : 固定容量的 ring buffer, 每格一次搜尋最多入列一次, 容量 = 格子數就夠
+*       visited: 每格記錄 stamp, 等於目前的 stamp 才算本次走過; 開始新搜尋只要 stamp + 1,
+*                不用把整張表清掉 (stamp 繞回 0 時才真的清一次)
+*       parent / depth 只在 visited 有效時才有意義, 同樣不用清
+**********************************************************************************************/
+
+#pragma once
+#include <vector>
+
+typedef struct GridSearch {
+    int width;
+    int height;
+
+    std::vector<int> queue;             // ring buffer, 容量 width*height
+    int head;
+    int count;
+
+    std::vector<unsigned int> visited;
+    std::vector<int> parent;            // 從哪一格走來, 起點為 -1
+    std::vector<int> depth;             // 步數
+    unsigned int stamp;
+} GridSearch;
+
+inline void InitGridSearch(GridSearch *search, int width, int height)
+{
+    int cells = width*height;
+    search->width = width;
+    search->height = height;
+    search->queue.assign(cells, 0);
+    search->head = 0;
+    search->count = 0;
+    search->visited.assign(cells, 0);
+    search->parent.assign(cells, -1);
+    search->depth.assign(cells, 0);
+    search->stamp = 0;
+}
+
+// 開始新的搜尋: 清空佇列, 換一個 stamp
+inline void BeginGridSearch(GridSearch *search)
+{
+    search->head = 0;
+    search->count = 0;
+    if (++search->stamp == 0)
+    {
+        for (size_t c = 0; c < search->visited.size(); c++) search->visited[c] = 0;
+        search->stamp = 1;
+    }
+}
+
+inline bool IsGridSearchVisited(const GridSearch *search, int cell) { return search->visited[cell] == search->stamp; }
+
+// 標記走過並入列; 已走過的格子不會再入列, 所以佇列不會滿
+inline void PushGridSearch(GridSearch *search, int cell, int parent, int depth)
+{
+    int capacity = (int)search->queue.size();
+    search->visited[cell] = search->stamp;
+    search->parent[cell] = parent;
+    search->depth[cell] = depth;
+    search->queue[(search->head + search->count)%capacity] = cell;
+    search->count++;
+}
+
+// 取出下一格, 佇列空了回傳 -1
+inline int PopGridSearch(GridSearch *search)
+{
+    if (search->count == 0) return -1;
+    int cell = search->queue[search->head];
+    search->head = (search->head + 1)%(int)search->queue.size();
+    search->count--;
+    return cell;
+}
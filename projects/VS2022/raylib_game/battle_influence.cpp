@@ -0,0 +1,142 @@
+﻿/**********************************************************************************************
+*   Battle influence / threat maps
+**********************************************************************************************/
+
+#include "battle_influence.h"
+#include "raylib.h"
+#include <string.h>
+
+#define INFLUENCE_STRIP     16      // 左右 pass 一次轉置幾列
+
+// 上下 pass: width*(height + 1), 左右 pass: 轉置暫存 + 上下 pass 的暫存
+size_t GetInfluenceScratchSize(int width, int height)
+{
+    size_t columns = (size_t)width*(height + 1);
+    size_t strip = (size_t)width*INFLUENCE_STRIP + (size_t)INFLUENCE_STRIP*(width + 1);
+    return (columns > strip)? columns : strip;
+}
+
+void InitInfluenceMap(InfluenceMap *map, int width, int height)
+{
+    map->width = width;
+    map->height = height;
+    for (int t = 0; t < TEAM_COUNT; t++)
+    {
+        map->support[t].assign((size_t)width*height, 0);
+        map->threat[t].assign((size_t)width*height, 0);
+    }
+    map->scratch.assign(GetInfluenceScratchSize(width, height), 0);
+}
+
+// 一維指數衰減的和 = 正向遞迴 + 反向遞迴 - 自己 (自己被算了兩次)
+// 沿著 y 方向做, 內層迴圈是整列連續記憶體上的 a[x] += FixedMul(decay, b[x]), 編譯器可以向量化
+//   第一趟: down[y] = data[y] + decay*down[y - 1], 存在 scratch
+//   第二趟 (由下往上): 結果 = down[y] + decay*up[y + 1], up 只保留一列
+// scratch 至少要 width*(height + 1)
+static void PropagateColumns(Fixed *data, Fixed *scratch, int width, int height, Fixed decay)
+{
+    Fixed *down = scratch;
+    Fixed *up = scratch + (size_t)width*height;
+
+    memcpy(down, data, sizeof(Fixed)*width);
+    for (int y = 1; y < height; y++)
+    {
+        Fixed *cur = &down[(size_t)y*width];
+        const Fixed *src = &data[(size_t)y*width];
+        const Fixed *prev = &down[(size_t)(y - 1)*width];
+        for (int x = 0; x < width; x++) cur[x] = src[x] + FixedMul(decay, prev[x]);
+    }
+
+    for (int x = 0; x < width; x++) up[x] = 0;
+    for (int y = height - 1; y >= 0; y--)
+    {
+        Fixed *cur = &data[(size_t)y*width];
+        const Fixed *d = &down[(size_t)y*width];
+        for (int x = 0; x < width; x++)
+        {
+            Fixed source = cur[x];
+            Fixed spread = FixedMul(decay, up[x]);
+            cur[x] = d[x] + spread;
+            up[x] = source + spread;
+        }
+    }
+}
+
+// 左右方向的遞迴在列內是相依的, 不能直接向量化: 每次取 INFLUENCE_STRIP 列轉置到暫存,
+// 用同一個逐列 kernel 算 (此時內層迴圈跨 INFLUENCE_STRIP 列), 再轉回來; 暫存小到可以留在 cache
+// scratch 大小見 GetInfluenceScratchSize
+void PropagateInfluence(Fixed *layer, Fixed *scratch, int width, int height, Fixed decay)
+{
+    Fixed *strip = scratch;
+    Fixed *temp = strip + (size_t)width*INFLUENCE_STRIP;
+
+    for (int y0 = 0; y0 < height; y0 += INFLUENCE_STRIP)
+    {
+        int rows = (height - y0 < INFLUENCE_STRIP)? height - y0 : INFLUENCE_STRIP;
+        Fixed *block = &layer[(size_t)y0*width];
+
+        for (int r = 0; r < rows; r++)
+            for (int x = 0; x < width; x++) strip[(size_t)x*rows + r] = block[(size_t)r*width + x];
+        PropagateColumns(strip, temp, rows, width, decay);
+        for (int r = 0; r < rows; r++)
+            for (int x = 0; x < width; x++) block[(size_t)r*width + x] = strip[(size_t)x*rows + r];
+    }
+
+    PropagateColumns(layer, scratch, width, height, decay);
+}
+
+void UpdateInfluenceMap(InfluenceMap *map, const UnitStore *store, const int *walls)
+{
+    int cellCount = map->width*map->height;
+    for (int t = 0; t < TEAM_COUNT; t++)
+    {
+        Fixed *support = map->support[t].data();
+        Fixed *threat = map->threat[t].data();
+        memset(support, 0, sizeof(Fixed)*cellCount);
+        memset(threat, 0, sizeof(Fixed)*cellCount);
+
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(store, (Team)t); i++)
+        {
+            int cell = store->y[i]*map->width + store->x[i];
+            support[cell] += store->hp[i];
+            threat[cell] += store->attack[i];
+        }
+
+        PropagateInfluence(support, map->scratch.data(), map->width, map->height, INFLUENCE_SUPPORT_DECAY);
+        PropagateInfluence(threat, map->scratch.data(), map->width, map->height, INFLUENCE_THREAT_DECAY);
+
+        if (walls != NULL)
+        {
+            for (int c = 0; c < cellCount; c++)
+            {
+                if (walls[c] == 1) { support[c] = 0; threat[c] = 0; }
+            }
+        }
+    }
+}
+
+#if defined(BATTLE_BENCHMARK)
+// 256x256 棋盤, 每隊 MAX_TEAM_UNITS 個單位, 重複量測取平均
+void RunInfluenceBenchmark(void)
+{
+    const int size = 256;
+    const int iterations = 200;
+
+    static UnitStore store;
+    InitUnitStore(&store);
+    for (int t = 0; t < TEAM_COUNT; t++)
+        for (int i = 0; i < MAX_TEAM_UNITS; i++)
+            AddUnit(&store, (Team)t, GetRandomValue(0, size - 1), GetRandomValue(0, size - 1), IntToFixed(10), IntToFixed(3), 1, 1, 0);
+
+    static InfluenceMap map;
+    InitInfluenceMap(&map, size, size);
+
+    double start = GetTime();
+    for (int k = 0; k < iterations; k++) UpdateInfluenceMap(&map, &store, NULL);
+    double elapsedUs = (GetTime() - start)*1000000.0/iterations;
+
+    TraceLog(LOG_INFO, "BENCHMARK: influence map %dx%d: %.1f us per update (budget %d us)", size, size, elapsedUs, INFLUENCE_BUDGET_US);
+    if (elapsedUs > INFLUENCE_BUDGET_US)
+        TraceLog(LOG_WARNING, "BENCHMARK: influence map OVER BUDGET: %.1f us > %d us per turn", elapsedUs, INFLUENCE_BUDGET_US);
+}
+#endif
@@ -0,0 +1,48 @@
+﻿/**********************************************************************************************
+*   Battle influence / threat maps
+*
+*   每隊兩層 Fixed 圖 (row-major, width*height):
+*       support[t]: 我方 hp 往外擴散, 越靠近友軍越高
+*       threat[t] : 該隊 attack 往外擴散, 越靠近敵人越危險
+*   擴散是可分離的指數衰減: 值 = sum(source * decay^(|dx| + |dy|)),
+*   上下方向是兩次 recursive pass, 每次整列一起算 (可向量化); 左右方向先轉置再用同一個 pass
+*   全程整數運算: 結果會決定 A* 的 tie-break, float 在不同編譯器 / 平台 (FMA 合併與否) 可能差一個 ulp,
+*   同一場戰鬥就會走出不同路線; 最大值 (32 隻滿級單位疊在一起) 仍在 Q16.16 範圍內
+*   NOTE: 擴散不看障礙, 障礙格本身清為 0
+*
+*   每回合 (不是每次移動) 重算一次; 定義 BATTLE_BENCHMARK 時 RunInfluenceBenchmark() 在大棋盤上量測,
+*   超過 INFLUENCE_BUDGET_US 時另外發出 LOG_WARNING
+**********************************************************************************************/
+
+#pragma once
+#include <vector>
+#include "battle_units.h"
+#include "battle_fixed.h"
+
+#define INFLUENCE_SUPPORT_DECAY     FloatToFixed(0.5f)
+#define INFLUENCE_THREAT_DECAY      FloatToFixed(0.7f)
+#define INFLUENCE_BUDGET_US         2000    // 256x256 棋盤一次完整重算 (4 層) 的時間上限
+
+typedef struct InfluenceMap {
+    int width;
+    int height;
+    std::vector<Fixed> support[TEAM_COUNT];
+    std::vector<Fixed> threat[TEAM_COUNT];
+    std::vector<Fixed> scratch;     // 轉置與 recursive pass 的暫存
+} InfluenceMap;
+
+void InitInfluenceMap(InfluenceMap *map, int width, int height);
+void UpdateInfluenceMap(InfluenceMap *map, const UnitStore *store, const int *walls);   // walls: 同 grid[][], 可為 NULL
+void PropagateInfluence(Fixed *layer, Fixed *scratch, int width, int height, Fixed decay);   // scratch: GetInfluenceScratchSize()
+size_t GetInfluenceScratchSize(int width, int height);
+
+// 對 team 來說某格的好壞: 友軍支援 - 敵方威脅, 只是兩次陣列讀取
+inline Fixed GetCellSafety(const InfluenceMap *map, Team team, int x, int y)
+{
+    int cell = y*map->width + x;
+    return map->support[team][cell] - map->threat[GetEnemyTeam(team)][cell];
+}
+
+#if defined(BATTLE_BENCHMARK)
+void RunInfluenceBenchmark(void);
+#endif
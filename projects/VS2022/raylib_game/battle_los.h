@@ -0,0 +1,140 @@
+﻿/**********************************************************************************************
+*   Battle line-of-sight table
+*
+*   每張地圖 (障礙配置) 只建一次: 每一格一個 bitset, 記錄從這格看得到的所有格子
+*   戰鬥中「射程內且看得到的敵人」= visible[cell] & 敵隊佔位 bitset, 不用每對單位都做 ray cast
+*
+*   視線: 兩格中心連線 (Bresenham) 經過的中間格都不是障礙即可見, 起點終點本身不算;
+*   只算 a < b 再雙向設定, 所以 a 看得到 b <=> b 看得到 a
+**********************************************************************************************/
+
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "battle_units.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#define LOS_MAX_CELLS   128
+#define LOS_MASK_WORDS  (LOS_MAX_CELLS/64)
+
+typedef struct CellMask {
+    uint64_t bits[LOS_MASK_WORDS];
+} CellMask;
+
+typedef struct LineOfSightTable {
+    int width;
+    int height;
+    CellMask visible[LOS_MAX_CELLS];
+} LineOfSightTable;
+
+inline void ClearCellMask(CellMask *mask)
+{
+    for (int w = 0; w < LOS_MASK_WORDS; w++) mask->bits[w] = 0;
+}
+
+inline void SetCellMaskBit(CellMask *mask, int cell) { mask->bits[cell >> 6] |= (uint64_t)1 << (cell & 63); }
+inline bool GetCellMaskBit(const CellMask *mask, int cell) { return (mask->bits[cell >> 6] >> (cell & 63)) & 1; }
+
+inline CellMask AndCellMask(const CellMask *a, const CellMask *b)
+{
+    CellMask result;
+    for (int w = 0; w < LOS_MASK_WORDS; w++) result.bits[w] = a->bits[w] & b->bits[w];
+    return result;
+}
+
+inline CellMask OrCellMask(const CellMask *a, const CellMask *b)
+{
+    CellMask result;
+    for (int w = 0; w < LOS_MASK_WORDS; w++) result.bits[w] = a->bits[w] | b->bits[w];
+    return result;
+}
+
+// 取出並清除最低的一個 bit, 空的回傳 -1
+inline int PopCellMaskBit(CellMask *mask)
+{
+    for (int w = 0; w < LOS_MASK_WORDS; w++)
+    {
+        uint64_t word = mask->bits[w];
+        if (word == 0) continue;
+#if defined(_MSC_VER)
+        unsigned long bit;
+        _BitScanForward64(&bit, word);
+#else
+        int bit = __builtin_ctzll(word);
+#endif
+        mask->bits[w] = word & (word - 1);
+        return w*64 + (int)bit;
+    }
+    return -1;
+}
+
+// Bresenham 走 (ax, ay) -> (bx, by), 中間格有障礙就擋住
+inline bool IsLineClear(const int *walls, int width, int ax, int ay, int bx, int by)
+{
+    int dx = abs(bx - ax), sx = (ax < bx)? 1 : -1;
+    int dy = -abs(by - ay), sy = (ay < by)? 1 : -1;
+    int err = dx + dy;
+    int x = ax, y = ay;
+
+    while (true)
+    {
+        int e2 = 2*err;
+        if (e2 >= dy) { err += dy; x += sx; }
+        if (e2 <= dx) { err += dx; y += sy; }
+        if ((x == bx) && (y == by)) return true;
+        if (walls[y*width + x] == 1) return false;
+    }
+}
+
+// walls: width*height, row-major, 1 = 障礙 (與 grid[][] 相同)
+inline void BuildLineOfSightTable(LineOfSightTable *table, const int *walls, int width, int height)
+{
+    table->width = width;
+    table->height = height;
+    int cellCount = width*height;
+    if (cellCount > LOS_MAX_CELLS) cellCount = LOS_MAX_CELLS;
+
+    for (int c = 0; c < cellCount; c++) ClearCellMask(&table->visible[c]);
+
+    for (int a = 0; a < cellCount; a++)
+    {
+        SetCellMaskBit(&table->visible[a], a);
+        for (int b = a + 1; b < cellCount; b++)
+        {
+            if (IsLineClear(walls, width, a%width, a/width, b%width, b/width))
+            {
+                SetCellMaskBit(&table->visible[a], b);
+                SetCellMaskBit(&table->visible[b], a);
+            }
+        }
+    }
+}
+
+// 某隊存活單位所在格子的 bitset
+inline CellMask GetTeamCellMask(const UnitStore *store, Team team, int width)
+{
+    CellMask mask;
+    ClearCellMask(&mask);
+    for (int i = GetTeamBegin(team); i < GetTeamEnd(store, team); i++) SetCellMaskBit(&mask, store->y[i]*width + store->x[i]);
+    return mask;
+}
+
+// 射程內 (曼哈頓距離) 且看得到的最近敵人, 沒有則回傳 -1
+inline int FindVisibleTarget(const LineOfSightTable *table, const UnitStore *store, int u)
+{
+    int width = table->width;
+    CellMask enemies = GetTeamCellMask(store, GetEnemyTeam(GetUnitTeam(u)), width);
+    CellMask candidates = AndCellMask(&table->visible[store->y[u]*width + store->x[u]], &enemies);
+
+    int bestCell = -1;
+    int bestDist = store->range[u] + 1;
+    for (int cell = PopCellMaskBit(&candidates); cell >= 0; cell = PopCellMaskBit(&candidates))
+    {
+        int d = abs(cell%width - store->x[u]) + abs(cell/width - store->y[u]);
+        if (d < bestDist) { bestDist = d; bestCell = cell; }
+    }
+    return (bestCell >= 0)? FindUnitAt(store, bestCell%width, bestCell/width) : -1;
+}
@@ -0,0 +1,409 @@
+﻿/**********************************************************************************************
+*   Monte Carlo tree search controller for one team
+**********************************************************************************************/
+
+#include "battle_mcts.h"
+#include <chrono>
+#include <math.h>
+
+static double GetMctsClock(void)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int NextMctsRandom(MctsTree *tree)
+{
+    unsigned int x = tree->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tree->rng = x;
+    return x;
+}
+
+static Fixed GetMctsTeamHP(const UnitStore *units, Team team)
+{
+    int alive;
+    Fixed hp;
+    GetUnitTeamStats(units, team, &alive, &hp);
+    return hp;
+}
+
+// 其他單位照預設行動, 直到輪到 team 的單位; 戰鬥結束或超過 horizon 回傳 false
+static bool AdvanceToMctsDecision(SetupBattle *sim, const MctsRoot *root, ScheduledAction *pending)
+{
+    while (PopSetupAction(sim, root->horizon, pending))
+    {
+        int u = GetUnitIndex(&sim->units, pending->unit);
+        if (GetUnitTeam(u) == root->team) return true;
+        ApplySetupAction(sim, pending, GetDefaultSetupAction(sim, u));
+    }
+    return false;
+}
+
+static float EvaluateMcts(const SetupBattle *sim, const MctsRoot *root)
+{
+    Fixed teamLoss = root->teamHP - GetMctsTeamHP(&sim->units, root->team);
+    Fixed enemyLoss = root->enemyHP - GetMctsTeamHP(&sim->units, GetEnemyTeam(root->team));
+    float value = (float)(enemyLoss - teamLoss)*root->scale;
+    if (sim->over) value += (sim->winner == root->team)? 1.0f : -1.0f;
+    return value;
+}
+
+// UCT; 還沒訪問過的子節點優先
+static int SelectMctsChild(const MctsTree *tree, int node)
+{
+    const MctsNode *parent = &tree->nodes[node];
+    float logVisits = logf((float)parent->visits);
+    int best = parent->firstChild;
+    float bestScore = -1e30f;
+    for (int c = parent->firstChild; c < parent->firstChild + parent->childCount; c++)
+    {
+        const MctsNode *child = &tree->nodes[c];
+        if (child->visits == 0) return c;
+        float score = child->value/child->visits + MCTS_EXPLORATION*sqrtf(logVisits/child->visits);
+        if (score > bestScore) { bestScore = score; best = c; }
+    }
+    return best;
+}
+
+static bool ExpandMctsNode(MctsTree *tree, int node, const SetupBattle *sim, int u)
+{
+    SetupAction actions[SETUP_MAX_ACTIONS];
+    int count = ListSetupActions(sim, u, actions);
+    if (tree->nodeCount + count > (int)tree->nodes.size()) return false;
+
+    tree->nodes[node].firstChild = tree->nodeCount;
+    tree->nodes[node].childCount = count;
+    for (int i = 0; i < count; i++) tree->nodes[tree->nodeCount++] = MctsNode{ actions[i], node, -1, 0, 0, 0.0f };
+    return true;
+}
+
+// 選擇 -> 展開 -> playout -> 回傳評分
+static void RunMctsIteration(MctsTree *tree, const MctsRoot *root, SetupBattle *sim)
+{
+    *sim = root->battle;
+    ScheduledAction pending = root->action;
+    bool deciding = true;
+    int node = 0;
+
+    while (deciding && (tree->nodes[node].firstChild >= 0))
+    {
+        node = SelectMctsChild(tree, node);
+        ApplySetupAction(sim, &pending, tree->nodes[node].action);
+        deciding = AdvanceToMctsDecision(sim, root, &pending);
+    }
+
+    if (deciding && ((node == 0) || (tree->nodes[node].visits > 0)) &&
+        ExpandMctsNode(tree, node, sim, GetUnitIndex(&sim->units, pending.unit)))
+    {
+        const MctsNode *parent = &tree->nodes[node];
+        node = parent->firstChild + (int)(NextMctsRandom(tree)%(unsigned int)parent->childCount);
+        ApplySetupAction(sim, &pending, tree->nodes[node].action);
+        deciding = AdvanceToMctsDecision(sim, root, &pending);
+    }
+
+    // playout: 該隊大多照預設行動, 偶爾隨機換一個
+    const unsigned int epsilon = (unsigned int)(MCTS_ROLLOUT_EPSILON*65536.0f);
+    while (deciding)
+    {
+        int u = GetUnitIndex(&sim->units, pending.unit);
+        SetupAction choice;
+        if ((NextMctsRandom(tree) & 0xffff) < epsilon)
+        {
+            SetupAction actions[SETUP_MAX_ACTIONS];
+            int count = ListSetupActions(sim, u, actions);
+            choice = actions[NextMctsRandom(tree)%(unsigned int)count];
+        }
+        else choice = GetDefaultSetupAction(sim, u);
+        ApplySetupAction(sim, &pending, choice);
+        deciding = AdvanceToMctsDecision(sim, root, &pending);
+    }
+
+    float value = EvaluateMcts(sim, root);
+    for (int n = node; n >= 0; n = tree->nodes[n].parent)
+    {
+        tree->nodes[n].visits++;
+        tree->nodes[n].value += value;
+    }
+    tree->playouts++;
+}
+
+static void ResetMctsTree(MctsTree *tree)
+{
+    tree->nodeCount = 1;
+    tree->nodes[0] = MctsNode{ SetupAction{ -1, 0, 0 }, -1, -1, 0, 0, 0.0f };
+    tree->playouts = 0;
+}
+
+// 至少跑一次 (根一定會展開), 之後到 until 為止或被取消
+static void SearchMctsTree(MctsTree *tree, const MctsRoot *root, double until, const std::atomic<bool> *cancel)
+{
+    SetupBattle sim;
+    do RunMctsIteration(tree, root, &sim);
+    while ((GetMctsClock() < until) && !cancel->load(std::memory_order_relaxed));
+}
+
+#if defined(MCTS_THREADED)
+// 每個 worker 負責一棵樹, 等 job 改變就搜尋到 deadline
+static void RunMctsWorker(MctsController *controller, int k)
+{
+    unsigned int done = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(controller->mutex);
+            controller->wake.wait(lock, [&]() { return controller->quit || (controller->job != done); });
+            if (controller->quit) return;
+            done = controller->job;
+        }
+
+        SearchMctsTree(&controller->trees[k], &controller->root, controller->root.deadline, &controller->cancel);
+
+        {
+            std::lock_guard<std::mutex> lock(controller->mutex);
+            controller->running--;
+        }
+        controller->idle.notify_all();
+    }
+}
+#endif
+
+void InitMctsController(MctsController *controller, Team team, double turnBudget, unsigned int seed)
+{
+    StopMctsController(controller);
+
+    controller->team = team;
+    controller->turnBudget = turnBudget;
+    controller->seed = (seed != 0)? seed : 1;
+    controller->stats = MctsStats{ 0, 0, 0.0, 0 };
+    controller->searching = false;
+    controller->cancel = false;
+
+#if defined(MCTS_THREADED)
+    // 主執行緒要繼續更新畫面, 留一個核心給它
+    int cores = (int)std::thread::hardware_concurrency();
+    controller->threadCount = (cores > 2)? cores - 1 : 1;
+    if (controller->threadCount > MCTS_MAX_THREADS) controller->threadCount = MCTS_MAX_THREADS;
+#else
+    controller->threadCount = 1;
+#endif
+
+    for (int k = 0; k < controller->threadCount; k++)
+    {
+        controller->trees[k].nodes.resize(MCTS_MAX_NODES);
+        controller->trees[k].nodeCount = 0;
+        controller->trees[k].playouts = 0;
+    }
+
+#if defined(MCTS_THREADED)
+    controller->job = 0;
+    controller->running = 0;
+    controller->quit = false;
+    for (int k = 0; k < controller->threadCount; k++) controller->workers[k] = std::thread(RunMctsWorker, controller, k);
+#endif
+}
+
+void StopMctsController(MctsController *controller)
+{
+    controller->cancel = true;
+#if defined(MCTS_THREADED)
+    {
+        std::lock_guard<std::mutex> lock(controller->mutex);
+        controller->quit = true;
+    }
+    controller->wake.notify_all();
+    for (int k = 0; k < MCTS_MAX_THREADS; k++)
+        if (controller->workers[k].joinable()) controller->workers[k].join();
+#endif
+    controller->searching = false;
+}
+
+// action 是剛由 PopSetupAction 取出、屬於 controller->team 的行動
+// 只有一個選擇時不用搜尋, 直接寫到 immediate 並回傳 false
+static bool BeginMctsSearch(MctsController *controller, const SetupBattle *battle, const ScheduledAction *action, SetupAction *immediate)
+{
+    const UnitStore *units = &battle->units;
+    int u = GetUnitIndex(units, action->unit);
+    controller->actionCount = ListSetupActions(battle, u, controller->actions);
+    if (controller->actionCount == 1)       // 被圍住, 只能原地等
+    {
+        *immediate = controller->actions[0];
+        return false;
+    }
+
+    // 每回合的預算平分給該隊這一回合的所有行動
+    Team team = controller->team;
+    int decisionsPerTurn = 0;
+    for (int i = GetTeamBegin(team); i < GetTeamEnd(units, team); i++) decisionsPerTurn += SCHEDULER_TICKS_PER_TURN/GetActionInterval(units->speed[i]);
+
+    MctsRoot *root = &controller->root;
+    root->battle = *battle;
+    root->action = *action;
+    root->team = team;
+    root->horizon = action->time + MCTS_HORIZON_TURNS*SCHEDULER_TICKS_PER_TURN;
+    root->teamHP = GetMctsTeamHP(units, team);
+    root->enemyHP = GetMctsTeamHP(units, GetEnemyTeam(team));
+    root->scale = 1.0f/(float)((root->teamHP + root->enemyHP > 0)? root->teamHP + root->enemyHP : 1);
+    root->start = GetMctsClock();
+    root->deadline = root->start + controller->turnBudget/decisionsPerTurn;
+
+    for (int k = 0; k < controller->threadCount; k++)
+    {
+        controller->trees[k].rng = controller->seed++*0x9e3779b9u + (unsigned int)k + 1;
+        ResetMctsTree(&controller->trees[k]);
+    }
+    controller->searching = true;
+
+#if defined(MCTS_THREADED)
+    {
+        std::lock_guard<std::mutex> lock(controller->mutex);
+        controller->job++;
+        controller->running = controller->threadCount;
+    }
+    controller->wake.notify_all();
+#endif
+    return true;
+}
+
+// 搜尋是否已經做完; 沒有執行緒時順便在這一幀的預算內搜尋一段
+static bool UpdateMctsSearch(MctsController *controller)
+{
+#if defined(MCTS_THREADED)
+    std::lock_guard<std::mutex> lock(controller->mutex);
+    return controller->running == 0;
+#else
+    double until = GetMctsClock() + MCTS_FRAME_BUDGET;
+    if (until > controller->root.deadline) until = controller->root.deadline;
+    SearchMctsTree(&controller->trees[0], &controller->root, until, &controller->cancel);
+    return GetMctsClock() >= controller->root.deadline;
+#endif
+}
+
+void WaitMctsSearch(MctsController *controller)
+{
+    if (!controller->searching) return;
+#if defined(MCTS_THREADED)
+    std::unique_lock<std::mutex> lock(controller->mutex);
+    controller->idle.wait(lock, [&]() { return controller->running == 0; });
+#else
+    while (!UpdateMctsSearch(controller)) { }
+#endif
+}
+
+bool IsMctsSearching(const MctsController *controller) { return controller->searching; }
+
+// 根的子節點順序在每棵樹都一樣 (同一個戰場的 ListSetupActions), 訪問次數直接加總
+static SetupAction FinishMctsSearch(MctsController *controller)
+{
+    int count = controller->actionCount;
+    int best = 0;
+    int bestVisits = -1;
+    for (int i = 0; i < count; i++)
+    {
+        int visits = 0;
+        for (int k = 0; k < controller->threadCount; k++)
+        {
+            const MctsTree *tree = &controller->trees[k];
+            if (tree->nodes[0].childCount == count) visits += tree->nodes[tree->nodes[0].firstChild + i].visits;
+        }
+        if (visits > bestVisits) { bestVisits = visits; best = i; }
+    }
+
+    for (int k = 0; k < controller->threadCount; k++)
+    {
+        controller->stats.playouts += controller->trees[k].playouts;
+        controller->stats.nodes += controller->trees[k].nodeCount;
+    }
+    controller->stats.seconds += GetMctsClock() - controller->root.start;
+    controller->stats.decisions++;
+    controller->searching = false;
+    return controller->actions[best];
+}
+
+bool StepMctsBattle(SetupBattle *battle, MctsController *controller, int untilTime)
+{
+    for (;;)
+    {
+        ScheduledAction action;
+        SetupAction choice;
+        if (controller->searching)
+        {
+            if (!UpdateMctsSearch(controller)) return battle->over;     // 還在想, 下一幀再看
+            action = controller->root.action;
+            choice = FinishMctsSearch(controller);
+        }
+        else
+        {
+            if (!PopSetupAction(battle, untilTime, &action)) return battle->over;
+            int u = GetUnitIndex(&battle->units, action.unit);
+            if (GetUnitTeam(u) != controller->team) choice = GetDefaultSetupAction(battle, u);
+            else if (BeginMctsSearch(controller, battle, &action, &choice)) continue;
+        }
+        ApplySetupAction(battle, &action, choice);
+        CheckSetupStalemate(battle, &action);
+    }
+}
+
+#if defined(BATTLE_BENCHMARK)
+#include "battle_encounter.h"
+#include "raylib.h"
+
+// 同一批隨機戰鬥 (GenerateEncounter) 與先攻順序, 藍隊分別用預設行動與 MCTS 打一次
+// 打不完時同 SimulateEncounter, 總 hp 高的一方獲勝
+void RunMctsBenchmark(void)
+{
+    const int encounterCount = 4;
+    const int seedCount = 2;
+    const int maxTurns = 60;
+
+    static Encounter encounter;
+    static LineOfSightTable lineOfSight;
+    static SetupBattle battle;
+    static MctsController controller;
+    InitMctsController(&controller, TEAM_BLUE, MCTS_TURN_BUDGET, 1);
+
+    int wins[2] = { 0, 0 };
+    Fixed margin[2] = { 0, 0 };
+    for (int e = 0; e < encounterCount; e++)
+    {
+        GenerateEncounter((unsigned int)e + 1, &encounter);
+        BuildLineOfSightTable(&lineOfSight, encounter.grid, ENCOUNTER_GRID_WIDTH, ENCOUNTER_GRID_HEIGHT);
+        for (int s = 1; s <= seedCount; s++)
+        {
+            for (int mode = 0; mode < 2; mode++)
+            {
+                StartSetupBattle(&battle, &encounter.units, &lineOfSight, encounter.grid, ENCOUNTER_GRID_WIDTH, ENCOUNTER_GRID_HEIGHT, (unsigned int)s);
+                for (int turn = 1; turn <= maxTurns; turn++)
+                {
+                    int until = turn*SCHEDULER_TICKS_PER_TURN;
+                    if (mode == 0) { if (StepSetupBattle(&battle, until)) break; continue; }
+
+                    // 同步跑: 每次搜尋都等它做完再繼續
+                    bool over = StepMctsBattle(&battle, &controller, until);
+                    while (!over && IsMctsSearching(&controller))
+                    {
+                        WaitMctsSearch(&controller);
+                        over = StepMctsBattle(&battle, &controller, until);
+                    }
+                    if (over) break;
+                }
+
+                Fixed blueHP = GetMctsTeamHP(&battle.units, TEAM_BLUE);
+                Fixed redHP = GetMctsTeamHP(&battle.units, TEAM_RED);
+                if (battle.over? (battle.winner == TEAM_BLUE) : (blueHP >= redHP)) wins[mode]++;
+                margin[mode] += blueHP - redHP;
+            }
+        }
+    }
+
+    int battles = encounterCount*seedCount;
+    const MctsStats *stats = &controller.stats;
+    TraceLog(LOG_INFO, "BENCHMARK: mcts %d threads, %.0f playouts/s, %.0f playouts per decision (%d decisions)",
+        controller.threadCount, (stats->seconds > 0.0)? stats->playouts/stats->seconds : 0.0, (double)stats->playouts/(stats->decisions > 0? stats->decisions : 1), stats->decisions);
+    TraceLog(LOG_INFO, "BENCHMARK: mcts vs default AI over %d battles (%.0f ms per turn): blue wins %d -> %d, avg hp margin %.1f -> %.1f",
+        battles, MCTS_TURN_BUDGET*1000.0, wins[0], wins[1], FixedToFloat(margin[0])/battles, FixedToFloat(margin[1])/battles);
+
+    StopMctsController(&controller);
+}
+#endif
@@ -0,0 +1,117 @@
+﻿/**********************************************************************************************
+*   Monte Carlo tree search controller for one team
+*
+*   替一隊 (team) 的單位做決定, 其他單位照 battle_setup_sim.h 的預設行動 (兵種的 behavior tree):
+*   樹的每個節點是「該隊某個單位輪到行動」的時刻, 子節點是 ListSetupActions 的每個行動;
+*   兩次決定之間的敵方行動都是確定的, 所以節點不存戰場狀態, 每次都從根的複本照路徑重播
+*   同隊多個單位依行動順序一個接一個決定, 等於把「整隊的聯合行動」拆成一串單一行動來搜尋
+*
+*   選擇用 UCT, 展開後以 ε-greedy 的 playout 打到 MCTS_HORIZON_TURNS 回合後評分:
+*       雙方損失 hp 的差 / 開場總 hp, 分出勝負再 +-1
+*   anytime: 時間一到就回傳目前訪問次數最多的行動; 每回合的時間預算 (turnBudget) 依該隊
+*   一回合內的行動次數平分給每次決定
+*
+*   root parallelism: 每個 worker 各自建一棵樹 (不同亂數), 時間到後把根的子節點訪問次數加總再挑
+*   worker 在 InitMctsController 時建立, 一直留到 StopMctsController, 每次決定只是喚醒它們;
+*   搜尋跨好幾幀: StepMctsBattle 輪到該隊時開始搜尋就先回傳, 之後每幀檢查, 時間到才套用結果繼續打,
+*   主執行緒不用等, 畫面照常更新
+*   PLATFORM_WEB 沒有執行緒, 只有一棵樹, 由 StepMctsBattle 每幀在 MCTS_FRAME_BUDGET 秒內搜尋一段
+*   定義 BATTLE_BENCHMARK 時 RunMctsBenchmark() 回報每秒 playout 數, 並在同樣的戰鬥上比較 MCTS 與預設行動
+**********************************************************************************************/
+
+#pragma once
+#include "battle_setup_sim.h"
+#include <atomic>
+#include <vector>
+
+#if !defined(PLATFORM_WEB)
+    #define MCTS_THREADED
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+#define MCTS_MAX_THREADS        4
+#define MCTS_MAX_NODES          8192        // 每棵樹; 滿了就不再展開, 只做 playout
+#define MCTS_HORIZON_TURNS      8
+#define MCTS_EXPLORATION        0.7f
+#define MCTS_ROLLOUT_EPSILON    0.15f       // playout 中該隊隨機行動的機率, 其餘照預設行動
+#define MCTS_TURN_BUDGET        0.02        // 每回合預設的思考時間 (秒)
+#define MCTS_FRAME_BUDGET       0.004       // 沒有執行緒時每幀最多花的時間 (秒)
+
+typedef struct MctsNode {
+    SetupAction action;                     // 從父節點走到這裡的行動
+    int parent;
+    int firstChild;                         // -1 = 還沒展開
+    int childCount;
+    int visits;
+    float value;                            // 累計評分 (該隊觀點)
+} MctsNode;
+
+typedef struct MctsTree {
+    std::vector<MctsNode> nodes;            // InitMctsController 時配置好, 搜尋中不再配置
+    int nodeCount;
+    unsigned int rng;
+    int playouts;
+} MctsTree;
+
+typedef struct MctsStats {
+    long long playouts;
+    long long nodes;
+    double seconds;
+    int decisions;
+} MctsStats;
+
+// 一次決定的搜尋條件, 所有 worker 共用 (搜尋中只讀)
+typedef struct MctsRoot {
+    SetupBattle battle;                     // 開始搜尋時戰場的複本
+    ScheduledAction action;                 // 輪到行動的單位 (已從 scheduler 取出)
+    Team team;
+    int horizon;                            // playout 打到這個 tick 為止
+    Fixed teamHP;                           // 開始搜尋時雙方的總 hp
+    Fixed enemyHP;
+    float scale;                            // 1/開場總 hp
+    double start;
+    double deadline;
+} MctsRoot;
+
+typedef struct MctsController {
+    Team team;
+    double turnBudget;                      // 每回合 (SCHEDULER_TICKS_PER_TURN tick) 的思考時間 (秒)
+    int threadCount;                        // 樹的數量 (有執行緒時 = worker 數)
+    MctsTree trees[MCTS_MAX_THREADS];
+    unsigned int seed;
+    MctsStats stats;                        // 累計
+
+    bool searching;                         // root.action 正在等搜尋結果
+    MctsRoot root;
+    int actionCount;                        // root.action 的候選行動, 順序同樹根的子節點
+    SetupAction actions[SETUP_MAX_ACTIONS];
+
+    std::atomic<bool> cancel;               // StopMctsController 時讓搜尋馬上結束
+#if defined(MCTS_THREADED)
+    std::thread workers[MCTS_MAX_THREADS];
+    std::mutex mutex;                       // 保護 job / running / quit
+    std::condition_variable wake;           // 有新的搜尋或要結束
+    std::condition_variable idle;           // 有 worker 搜尋完
+    unsigned int job;                       // 第幾次搜尋, 變了 worker 才開始
+    int running;                            // 還在搜尋的 worker 數
+    bool quit;
+#endif
+} MctsController;
+
+// 建立 worker (已經有就先停掉舊的); 離開畫面前要呼叫 StopMctsController
+void InitMctsController(MctsController *controller, Team team, double turnBudget, unsigned int seed);
+void StopMctsController(MctsController *controller);
+
+// 同 StepSetupBattle, 但 controller->team 的單位由 MCTS 決定; 不會停下來等搜尋:
+// 輪到該隊時開始搜尋並回傳, 之後的呼叫搜尋完才套用並繼續 (搜尋中 battle 只能交給 StepMctsBattle 推進)
+bool StepMctsBattle(SetupBattle *battle, MctsController *controller, int untilTime);
+bool IsMctsSearching(const MctsController *controller);
+
+// 等目前的搜尋做完 (不需要維持畫面的地方用, 例如 benchmark)
+void WaitMctsSearch(MctsController *controller);
+
+#if defined(BATTLE_BENCHMARK)
+void RunMctsBenchmark(void);
+#endif
@@ -0,0 +1,368 @@
+﻿/**********************************************************************************************
+*   Cooperative pathfinding (windowed hierarchical cooperative A*)
+**********************************************************************************************/
+
+#include "battle_path.h"
+#include "battle_zobrist.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdlib.h>
+
+static const int pathDirs[5][2] = { {0,0},{0,1},{0,-1},{1,0},{-1,0} };     // 第一個是原地等待
+
+// std::push_heap 是 max-heap, 所以「比較差」的回傳 true
+static bool PathOpenWorse(const PathOpenNode &a, const PathOpenNode &b)
+{
+    if (a.f != b.f) return a.f > b.f;
+    if (a.g != b.g) return a.g < b.g;       // f 相同時先展開走得比較遠的
+    if (a.bonus != b.bonus) return a.bonus < b.bonus;
+    return a.node > b.node;
+}
+
+// 可走的格子成本全都相同 (例如只有空地) 時回傳該成本, 距離場可以直接用 BFS; 否則回傳 0
+static int GetUniformTerrainCost(const int *walls, int cells)
+{
+    int cost = 0;
+    for (int c = 0; c < cells; c++)
+    {
+        if (!IsTerrainWalkable(walls[c])) continue;
+        if (cost == 0) cost = GetTerrainCost(walls[c]);
+        else if (GetTerrainCost(walls[c]) != cost) return 0;
+    }
+    return cost;
+}
+
+void InitPathPlanner(PathPlanner *planner, const int *walls, int width, int height)
+{
+    int cells = width*height;
+    int nodes = cells*(PATH_WINDOW + 1);
+
+    planner->width = width;
+    planner->height = height;
+    planner->walls = walls;
+    InitDStarGraph(&planner->graph, width, height);
+    planner->plans.resize(MAX_BATTLE_UNITS);
+    for (int i = 0; i < MAX_BATTLE_UNITS; i++) InitDStarLite(&planner->plans[i], cells);
+    planner->occupied.assign(cells, 0);
+
+    planner->reservationCount.assign(cells, 0);
+    planner->reservations.assign((size_t)cells*PATH_MAX_RESERVATIONS, PathReservation{ 0, 0, INVALID_UNIT_HANDLE });
+    planner->ownerCellCount.assign(MAX_BATTLE_UNITS, 0);
+    planner->ownerCells.assign(MAX_BATTLE_UNITS*PATH_OWNER_CELLS, 0);
+
+    planner->distance.assign(cells, -1);
+    planner->queue.assign(cells, 0);
+    InitBucketQueue(&planner->buckets, cells*4 + 1);    // 每格只在確定距離時推一次鄰居, 最多 4 個
+    planner->uniformCost = GetUniformTerrainCost(walls, cells);
+    planner->parent.assign(nodes, -1);
+    planner->visited.assign(nodes, 0);
+    planner->open.clear();
+    planner->open.reserve((size_t)nodes*5 + 1);     // 每個關閉的節點最多推 5 個後繼
+    planner->path.clear();
+    planner->path.reserve(PATH_WINDOW + 1);
+    planner->searchStamp = 0;
+    planner->now = 0;
+    planner->nodesExpanded = 0;
+}
+
+void ClearPathReservations(PathPlanner *planner)
+{
+    std::fill(planner->reservationCount.begin(), planner->reservationCount.end(), 0);
+    std::fill(planner->ownerCellCount.begin(), planner->ownerCellCount.end(), 0);
+    planner->now = 0;
+}
+
+// 格子滿了時先丟掉已結束的預約; 還是滿的就放棄這筆 (IsCellReserved 會把滿的格子當成被佔用)
+void ReserveCell(PathPlanner *planner, int cell, int from, int to, UnitHandle owner)
+{
+    int slot = (int)(owner & 0xffff);
+    int *ownerCells = &planner->ownerCells[(size_t)slot*PATH_OWNER_CELLS];
+    int &ownerCount = planner->ownerCellCount[slot];
+    bool listed = false;
+    for (int i = 0; i < ownerCount; i++) listed |= (ownerCells[i] == cell);
+    if (!listed)
+    {
+        assert(ownerCount < PATH_OWNER_CELLS);      // 每次預約前都會先 ReleasePathReservations
+        ownerCells[ownerCount++] = cell;
+    }
+
+    PathReservation *slots = &planner->reservations[(size_t)cell*PATH_MAX_RESERVATIONS];
+    int &count = planner->reservationCount[cell];
+
+    if (count >= PATH_MAX_RESERVATIONS)
+    {
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+            if (slots[i].to > planner->now) slots[kept++] = slots[i];
+        count = kept;
+    }
+    if (count < PATH_MAX_RESERVATIONS) slots[count++] = PathReservation{ from, to, owner };
+}
+
+// 只看 owner 預約過的格子, 順便丟掉這些格子裡已結束的預約
+void ReleasePathReservations(PathPlanner *planner, UnitHandle owner)
+{
+    int slot = (int)(owner & 0xffff);
+    const int *ownerCells = &planner->ownerCells[(size_t)slot*PATH_OWNER_CELLS];
+    for (int k = 0; k < planner->ownerCellCount[slot]; k++)
+    {
+        int c = ownerCells[k];
+        PathReservation *slots = &planner->reservations[(size_t)c*PATH_MAX_RESERVATIONS];
+        int &count = planner->reservationCount[c];
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+            if ((slots[i].owner != owner) && (slots[i].to > planner->now)) slots[kept++] = slots[i];
+        count = kept;
+    }
+    planner->ownerCellCount[slot] = 0;
+}
+
+// [from, to) 是否與其他單位的預約重疊
+bool IsCellReserved(const PathPlanner *planner, int cell, int from, int to, UnitHandle owner)
+{
+    int count = planner->reservationCount[cell];
+    if (count >= PATH_MAX_RESERVATIONS) return true;
+
+    const PathReservation *slots = &planner->reservations[(size_t)cell*PATH_MAX_RESERVATIONS];
+    for (int i = 0; i < count; i++)
+    {
+        if (slots[i].owner == owner) continue;
+        if ((slots[i].from < to) && (from < slots[i].to)) return true;
+    }
+    return false;
+}
+
+// 已開始的預約只看剩下的部分 ([now, to)), 同樣的佔用在不同 tick 出現也算同一個狀態
+// 依 slot 走各自預約過的格子 (格子不重複, 每筆預約只算一次); 陣亡單位的預約在 Release 時已清掉
+uint64_t GetPathReservationKey(const PathPlanner *planner, int now)
+{
+    uint64_t key = 0;
+    for (int slot = 0; slot < MAX_BATTLE_UNITS; slot++)
+    {
+        const int *ownerCells = &planner->ownerCells[(size_t)slot*PATH_OWNER_CELLS];
+        for (int k = 0; k < planner->ownerCellCount[slot]; k++)
+        {
+            int c = ownerCells[k];
+            const PathReservation *slots = &planner->reservations[(size_t)c*PATH_MAX_RESERVATIONS];
+            for (int i = 0; i < planner->reservationCount[c]; i++)
+            {
+                if (((int)(slots[i].owner & 0xffff) != slot) || (slots[i].to <= now)) continue;
+                int from = (slots[i].from > now)? slots[i].from - now : 0;
+                uint64_t span = ((uint64_t)(unsigned int)c << 32) | ((uint64_t)(from & 0xffff) << 16) | (uint64_t)((slots[i].to - now) & 0xffff);
+                key ^= MixZobristKey(span ^ MixZobristKey(slots[i].owner));
+            }
+        }
+    }
+    return key;
+}
+
+void BuildDistanceField(PathPlanner *planner, int goal)
+{
+    int width = planner->width;
+    int cells = width*planner->height;
+    int *distance = planner->distance.data();
+    BucketQueue *queue = &planner->buckets;
+
+    for (int c = 0; c < cells; c++) distance[c] = -1;
+    distance[goal] = 0;
+
+    if (planner->uniformCost > 0)
+    {
+        // 成本全都相同: 除了走進 goal 的第一步 (固定 1, 同下面的 Dijkstra) 每步一樣, 普通的 BFS 比 Dijkstra 快
+        int *fifo = planner->queue.data();
+        int head = 0, tail = 0;
+        fifo[tail++] = goal;
+        while (head < tail)
+        {
+            int cur = fifo[head++];
+            planner->nodesExpanded++;
+            int cx = cur%width, cy = cur/width;
+            for (int i = 1; i < 5; i++)
+            {
+                int nx = cx + pathDirs[i][0];
+                int ny = cy + pathDirs[i][1];
+                if (nx < 0 || nx >= width || ny < 0 || ny >= planner->height) continue;
+                int next = ny*width + nx;
+                if (!IsTerrainWalkable(planner->walls[next]) || (distance[next] >= 0)) continue;
+                distance[next] = distance[cur] + ((cur == goal)? 1 : planner->uniformCost);
+                fifo[tail++] = next;
+            }
+        }
+        return;
+    }
+
+    ClearBucketQueue(queue);
+
+    // 從 goal 往外擴散: 由 next 走進 cur 的成本是 cur 的地形成本 (goal 被敵人佔著, 固定算 1, 同 D* Lite)
+    PushBucket(queue, 0, goal);
+    int key, cur;
+    while (PopBucket(queue, &key, &cur))
+    {
+        if (key != distance[cur]) continue;     // 過期的 entry
+        planner->nodesExpanded++;
+
+        int cx = cur%width, cy = cur/width;
+        int enterCost = (cur == goal)? 1 : GetTerrainCost(planner->walls[cur]);
+        for (int i = 1; i < 5; i++)
+        {
+            int nx = cx + pathDirs[i][0];
+            int ny = cy + pathDirs[i][1];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= planner->height) continue;
+            int next = ny*width + nx;
+            if (!IsTerrainWalkable(planner->walls[next])) continue;
+
+            int d = key + enterCost;
+            if (distance[next] >= 0 && distance[next] <= d) continue;
+            distance[next] = d;
+            PushBucket(queue, d, next);
+        }
+    }
+}
+
+void UpdatePathCosts(PathPlanner *planner, const UnitStore *store)
+{
+    int width = planner->width;
+    int cells = width*planner->height;
+
+    unsigned char *occupied = planner->occupied.data();
+    for (int c = 0; c < cells; c++) occupied[c] = 0;
+    for (int t = 0; t < TEAM_COUNT; t++)
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(store, (Team)t); i++) occupied[store->y[i]*width + store->x[i]] = 1;
+
+    planner->uniformCost = GetUniformTerrainCost(planner->walls, cells);
+    for (int c = 0; c < cells; c++)
+    {
+        int terrain = planner->walls[c];
+        SetDStarCellCost(&planner->graph, c, IsTerrainWalkable(terrain)? GetTerrainCost(terrain) : DSTAR_INFINITY);
+    }
+}
+
+void MovePathOccupant(PathPlanner *planner, int from, int to)
+{
+    if (from >= 0) planner->occupied[from] = 0;
+    if (to >= 0) planner->occupied[to] = 1;
+}
+
+// 把 path (path[0] = start) 預約起來, 最後一格一路留到視窗結束
+static void ReservePath(PathPlanner *planner, UnitHandle owner, int now, int interval)
+{
+    int steps = (int)planner->path.size() - 1;
+    for (int k = 1; k <= steps; k++)
+    {
+        int to = (k == steps)? now + PATH_WINDOW*interval + 1 : now + k*interval + 1;
+        ReserveCell(planner, planner->path[k], now + (k - 1)*interval, to, owner);
+    }
+}
+
+int PlanCooperativeStep(PathPlanner *planner, UnitHandle owner, int start, int goal, int now, int interval, const Fixed *bonus)
+{
+    int width = planner->width;
+    int cells = width*planner->height;
+
+    planner->now = now;
+    ReleasePathReservations(planner, owner);
+
+    DStarLite *plan = &planner->plans[owner & 0xffff];
+    // A* 只會走到起點 PATH_WINDOW 步內的格子, 這些格子的 key 最多比起點多 window*(最大成本 + 1)
+    const int margin = PATH_WINDOW*(TERRAIN_MAX_COST + 1);
+
+    // 目標 (敵人) 只移動了一點時沿用以舊目標為根的計畫, 只修補成本變化, 不因目標移動整個重建:
+    // 到舊根的成本 d(c) <= d(c, goal) - 1 + cost(goal) + d(goal), 所以 h(c) = d(c) - offset 不會高估, 也仍然一致
+    int root = goal;
+    int offset = 0;
+    if ((plan->owner == owner) && (plan->goal >= 0) && (plan->goal != goal))
+    {
+        planner->nodesExpanded += UpdateDStarLite(plan, &planner->graph, owner, start, plan->goal, margin);
+        int d = GetDStarDistance(plan, goal);
+        if ((d >= 0) && (d + planner->graph.cost[goal] - 1 <= PATH_GOAL_SLACK))
+        {
+            root = plan->goal;
+            offset = d + planner->graph.cost[goal] - 1;
+        }
+    }
+    planner->nodesExpanded += UpdateDStarLite(plan, &planner->graph, owner, start, root, margin);
+    if (GetDStarDistance(plan, start) < 0) return -1;
+
+    // heuristic: D* Lite 的成本; 視窗內的格子都已算到一致, 其餘 (理論上碰不到) 才用曼哈頓距離
+    auto Remaining = [&](int cell)
+    {
+        int d = GetDStarDistance(plan, cell);
+        if (d < 0) return abs(cell%width - goal%width) + abs(cell/width - goal/width);
+        return (d > offset)? d - offset : 0;
+    };
+    auto IsGoalAdjacent = [&](int cell) { return abs(cell%width - goal%width) + abs(cell/width - goal/width) <= 1; };
+
+    // 已經在目標旁邊: 原地待到視窗結束
+    planner->path.clear();
+    planner->path.push_back(start);
+    if (IsGoalAdjacent(start))
+    {
+        planner->path.push_back(start);
+        ReservePath(planner, owner, now, interval);
+        return start;
+    }
+
+    if (++planner->searchStamp == 0)
+    {
+        std::fill(planner->visited.begin(), planner->visited.end(), 0);
+        planner->searchStamp = 1;
+    }
+
+    std::vector<PathOpenNode> &open = planner->open;
+    open.clear();
+    open.push_back(PathOpenNode{ Remaining(start), 0, 0.0f, start, -1 });
+
+    int found = -1;
+    while (!open.empty())
+    {
+        std::pop_heap(open.begin(), open.end(), PathOpenWorse);
+        PathOpenNode cur = open.back();
+        open.pop_back();
+
+        if (planner->visited[cur.node] == planner->searchStamp) continue;
+        planner->visited[cur.node] = planner->searchStamp;
+        planner->parent[cur.node] = cur.parent;
+        planner->nodesExpanded++;
+
+        int step = cur.node/cells;
+        int cell = cur.node%cells;
+        if (IsGoalAdjacent(cell) || (step == PATH_WINDOW)) { found = cur.node; break; }
+
+        // 第 step + 1 步佔用 [now + step*interval, now + (step + 1)*interval]
+        int from = now + step*interval;
+        int to = now + (step + 1)*interval + 1;
+        int cx = cell%width, cy = cell/width;
+        for (int i = 0; i < 5; i++)
+        {
+            int nx = cx + pathDirs[i][0];
+            int ny = cy + pathDirs[i][1];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= planner->height) continue;
+
+            int next = ny*width + nx;
+            int node = (step + 1)*cells + next;
+            if (!IsTerrainWalkable(planner->walls[next]) || (planner->visited[node] == planner->searchStamp)) continue;
+            if (IsCellReserved(planner, next, from, to, owner)) continue;
+
+            // 地形成本 (原地等待 = 再付一次所在格的成本) + 走進別人佔著的格子的懲罰;
+            // heuristic 只算地形, 懲罰 >= 0 所以 heuristic 仍不會高估且一致
+            int g = cur.g + GetTerrainCost(planner->walls[next]) + ((next != cell) && (next != start) && planner->occupied[next]? PATH_OCCUPIED_PENALTY : 0);
+            open.push_back(PathOpenNode{ g + Remaining(next), g, (bonus != NULL)? bonus[next] : 0, node, cur.node });
+            std::push_heap(open.begin(), open.end(), PathOpenWorse);
+        }
+    }
+
+    // 每條路都被預約擋住: 原地等一步
+    if (found < 0)
+    {
+        planner->path.push_back(start);
+        ReservePath(planner, owner, now, interval);
+        return start;
+    }
+
+    planner->path.clear();
+    for (int node = found; node >= 0; node = planner->parent[node]) planner->path.push_back(node%cells);
+    std::reverse(planner->path.begin(), planner->path.end());
+    ReservePath(planner, owner, now, interval);
+
+    return planner->path[1];
+}
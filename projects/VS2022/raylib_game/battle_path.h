@@ -0,0 +1,95 @@
+﻿/**********************************************************************************************
+*   Cooperative pathfinding (windowed hierarchical cooperative A*)
+*
+*   所有單位共用一張時空預約表: 每格記錄 [from, to) tick 區間被哪個單位佔用;
+*   每個 handle slot 另記自己預約過的格子, 釋放預約與算僵局 key 只看這些格子, 不掃整個棋盤
+*   單位行動時先釋放自己的預約, 在 (格子, 第 k 步) 空間上做 A*, 只看 PATH_WINDOW 步,
+*   避開別人已預約的時段, 再把新路線預約起來; 後面行動的單位就會自動讓開或排隊
+*
+*   搜尋成本是地形成本 (原地等待 = 所在格的成本) + 走進別人佔著的格子的 PATH_OCCUPIED_PENALTY, 時間則以步數計算;
+*   時間單位與 battle_scheduler 相同 (tick), 單位每 interval tick 走一步:
+*       第 k 步 (k >= 1) 的格子佔用 [now + (k - 1)*interval, now + k*interval]
+*   預約多涵蓋結束那個 tick, 同一個 tick 先行動的單位不會踩進還沒離開的格子
+*
+*   heuristic 是每個單位各自的 D* Lite 計畫 (battle_dstar.h) 算出的到目標地形成本, 不含佔用懲罰,
+*   所以不會高估且一致; 棋盤改變時只修補受影響的部分
+*   目標只移動了 PATH_GOAL_SLACK 成本以內時計畫沿用舊的根, heuristic 扣掉目標到舊根的成本, 真的換目標才重建
+**********************************************************************************************/
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "battle_units.h"
+#include "battle_dstar.h"
+#include "battle_bucket_queue.h"
+
+#define PATH_WINDOW                 8       // 每次規劃往前看幾步
+#define PATH_MAX_RESERVATIONS       16      // 每格最多幾筆預約, 滿了視為被佔用
+#define PATH_OCCUPIED_PENALTY       (3*TERRAIN_FLOOR_COST)  // 走進被佔用格子的額外成本 (加在地形成本上), 讓路線繞開人群
+#define PATH_GOAL_SLACK             TERRAIN_MAX_COST    // 目標離 D* Lite 計畫的根在這個成本內就不重建
+#define PATH_OWNER_CELLS            (PATH_WINDOW + 1)   // 一個單位同時最多預約幾格 (一條路線或原地一格)
+
+typedef struct PathReservation {
+    int from;               // tick, 含
+    int to;                 // tick, 不含
+    UnitHandle owner;
+} PathReservation;
+
+typedef struct PathOpenNode {
+    int f;                  // 已走成本 + 剩餘成本
+    int g;                  // 已走成本 (地形 + 佔用懲罰), 步數另由 node 得知
+    Fixed bonus;            // f 相同時 bonus 高的先展開
+    int node;               // step*cells + cell
+    int parent;
+} PathOpenNode;
+
+typedef struct PathPlanner {
+    int width;
+    int height;
+    const int *walls;                               // 同 grid[][], 值為 TerrainType
+
+    DStarGraph graph;                               // 格子成本, 由 UpdatePathCosts 維護
+    std::vector<DStarLite> plans;                   // 每個 handle slot 一份持續保存的計畫
+    std::vector<unsigned char> occupied;            // 被單位佔著的格子 (A* 的佔用懲罰): UpdatePathCosts 建立, 之後由 MovePathOccupant 逐格維護
+
+    std::vector<int> reservationCount;              // 每格預約數
+    std::vector<PathReservation> reservations;      // cell*PATH_MAX_RESERVATIONS + i
+    std::vector<int> ownerCellCount;                // 每個 handle slot 目前有預約的格子數
+    std::vector<int> ownerCells;                    // slot*PATH_OWNER_CELLS + i, 不重複
+
+    // 搜尋暫存, InitPathPlanner 時配置好, 規劃時不再配置記憶體
+    std::vector<int> distance;                      // BuildDistanceField 的結果, -1 = 到不了
+    std::vector<int> queue;                         // BuildDistanceField 的 BFS 佇列 (所有可走格成本相同時)
+    BucketQueue buckets;                            // BuildDistanceField 的 Dijkstra 佇列 (有加權地形時)
+    int uniformCost;                                // 可走格的地形成本都相同時為該成本, 否則 0; 由 UpdatePathCosts 維護
+    std::vector<int> parent;                        // 時空節點 (step*cells + cell) 的前一個節點
+    std::vector<unsigned int> visited;              // 時空節點的 stamp, 等於 searchStamp 表示本次已關閉
+    std::vector<PathOpenNode> open;                 // binary heap (std::push_heap)
+    std::vector<int> path;
+    unsigned int searchStamp;
+    int now;                                        // 最近一次規劃的 tick, 之前結束的預約都已失效
+
+    int nodesExpanded;                              // 累計展開節點數 (BFS + D* Lite + A*)
+} PathPlanner;
+
+void InitPathPlanner(PathPlanner *planner, const int *walls, int width, int height);
+void ClearPathReservations(PathPlanner *planner);
+void ReserveCell(PathPlanner *planner, int cell, int from, int to, UnitHandle owner);
+void ReleasePathReservations(PathPlanner *planner, UnitHandle owner);
+bool IsCellReserved(const PathPlanner *planner, int cell, int from, int to, UnitHandle owner);
+
+// 還沒結束的預約 (格子, 相對 now 的區間, owner) 的 Zobrist key, 判斷僵局時與戰場 hash 一起比較
+uint64_t GetPathReservationKey(const PathPlanner *planner, int now);
+
+// 從 goal 出發、依地形成本的距離場, 存到 planner->distance; 成本全都相同時用 BFS, 否則用 bucket queue 的 Dijkstra
+void BuildDistanceField(PathPlanner *planner, int goal);
+
+// 依地形與存活單位整個重算格子成本與佔位, 只有改變的格子會進 change log; 開場或換地圖時呼叫
+void UpdatePathCosts(PathPlanner *planner, const UnitStore *store);
+
+// 單位從 from 移到 to 的佔位變化 (-1 = 沒有: 出生時 from = -1, 陣亡時 to = -1), 每次只動兩格
+void MovePathOccupant(PathPlanner *planner, int from, int to);
+
+// 規劃 owner 從 start 走到 goal 旁邊的路線並預約, 回傳這次行動要走到的格子 (原地等待就是 start)
+// bonus 可為 NULL: 同樣步數時偏好 bonus 高的格子 (例如支援 - 威脅); 目標到不了回傳 -1
+int PlanCooperativeStep(PathPlanner *planner, UnitHandle owner, int start, int goal, int now, int interval, const Fixed *bonus);
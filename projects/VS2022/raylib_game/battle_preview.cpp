@@ -0,0 +1,132 @@
+﻿/**********************************************************************************************
+*   Setup battle outcome preview
+**********************************************************************************************/
+
+#include "battle_preview.h"
+#include "raylib.h"
+
+// 以第 seed 種先攻順序打一場; generation 變了 (配置已更新) 就中途放棄, 回傳 false
+static bool RunPreviewBattle(OutcomePreview *preview, SetupBattle *battle, const UnitStore *units, unsigned int generation, unsigned int seed)
+{
+    StartSetupBattle(battle, units, preview->lineOfSight, preview->walls, preview->width, preview->height, seed);
+    for (int turn = 1; turn <= PREVIEW_MAX_TURNS; turn++)
+    {
+        if (preview->generation.load(std::memory_order_relaxed) != generation) return false;
+        if (StepSetupBattle(battle, turn*SCHEDULER_TICKS_PER_TURN)) break;
+    }
+    return true;
+}
+
+static void RecordPreviewBattle(OutcomePreview *preview, const SetupBattle *battle, unsigned int generation)
+{
+    std::lock_guard<std::mutex> lock(preview->mutex);
+    OutcomeEstimate *estimate = &preview->estimate;
+    if (estimate->generation != generation) return;
+
+    estimate->runs++;
+    if (battle->over)
+    {
+        estimate->finished++;
+        estimate->totalTicks += battle->endTime;
+        if (battle->winner == TEAM_BLUE) estimate->wins++;
+    }
+}
+
+#if defined(OUTCOME_PREVIEW_THREADED)
+static void RunOutcomePreviewWorker(OutcomePreview *preview)
+{
+    UnitStore units;
+    SetupBattle battle;
+    unsigned int done = 0;
+    for (;;)
+    {
+        unsigned int generation;
+        {
+            std::unique_lock<std::mutex> lock(preview->mutex);
+            preview->wake.wait(lock, [&]() { return preview->quit || (preview->generation.load() != done); });
+            if (preview->quit) return;
+            generation = preview->generation.load();
+            units = preview->units;
+        }
+
+        for (int s = 0; s < PREVIEW_SEED_COUNT; s++)
+        {
+            if (!RunPreviewBattle(preview, &battle, &units, generation, (unsigned int)s + 1)) break;
+            RecordPreviewBattle(preview, &battle, generation);
+        }
+        done = generation;
+    }
+}
+#endif
+
+void StartOutcomePreview(OutcomePreview *preview, const LineOfSightTable *lineOfSight, const int *walls, int width, int height)
+{
+    preview->lineOfSight = lineOfSight;
+    preview->walls = walls;
+    preview->width = width;
+    preview->height = height;
+    preview->generation.store(0);
+    preview->estimate = OutcomeEstimate{ 0, 0, 0, 0, 0 };
+
+#if defined(OUTCOME_PREVIEW_THREADED)
+    preview->quit = false;
+    preview->worker = std::thread(RunOutcomePreviewWorker, preview);
+#else
+    preview->nextSeed = PREVIEW_SEED_COUNT;
+#endif
+}
+
+void StopOutcomePreview(OutcomePreview *preview)
+{
+#if defined(OUTCOME_PREVIEW_THREADED)
+    if (!preview->worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(preview->mutex);
+        preview->quit = true;
+        preview->generation++;          // 讓還在打的那場馬上放棄
+    }
+    preview->wake.notify_one();
+    preview->worker.join();
+#else
+    preview->nextSeed = PREVIEW_SEED_COUNT;
+#endif
+}
+
+void RequestOutcomePreview(OutcomePreview *preview, const UnitStore *units)
+{
+    {
+        std::lock_guard<std::mutex> lock(preview->mutex);
+        preview->units = *units;
+        unsigned int generation = preview->generation.load() + 1;
+        preview->estimate = OutcomeEstimate{ generation, 0, 0, 0, 0 };
+        preview->generation.store(generation);
+    }
+#if defined(OUTCOME_PREVIEW_THREADED)
+    preview->wake.notify_one();
+#else
+    preview->nextSeed = 0;
+#endif
+}
+
+void UpdateOutcomePreview(OutcomePreview *preview)
+{
+#if defined(OUTCOME_PREVIEW_THREADED)
+    (void)preview;                      // 背景 worker 自己會跑
+#else
+    static SetupBattle battle;
+    unsigned int generation = preview->generation.load();
+    double start = GetTime();
+    while ((preview->nextSeed < PREVIEW_SEED_COUNT) && (GetTime() - start < PREVIEW_FRAME_BUDGET))
+    {
+        RunPreviewBattle(preview, &battle, &preview->units, generation, (unsigned int)preview->nextSeed + 1);
+        RecordPreviewBattle(preview, &battle, generation);
+        preview->nextSeed++;
+    }
+#endif
+}
+
+OutcomeEstimate GetOutcomeEstimate(OutcomePreview *preview)
+{
+    std::lock_guard<std::mutex> lock(preview->mutex);
+    return preview->estimate;
+}
@@ -0,0 +1,69 @@
+﻿/**********************************************************************************************
+*   Setup battle outcome preview
+*
+*   放置單位時在背景把目前的配置以 PREVIEW_SEED_COUNT 種先攻順序各打一場 (battle_setup_sim.h),
+*   估計藍隊勝率與平均回合數, 不用等真的開打
+*
+*   每次 RequestOutcomePreview 都把 generation + 1; 模擬每打完一回合就比對 generation,
+*   配置被更新就立刻放棄舊的那批, 改算新的, 畫面永遠只顯示最新配置的結果
+*   有執行緒時在背景 worker 上跑; PLATFORM_WEB 沒有執行緒, 改由 UpdateOutcomePreview()
+*   每幀在 PREVIEW_FRAME_BUDGET 秒內跑幾場
+**********************************************************************************************/
+
+#pragma once
+#include "battle_setup_sim.h"
+#include <atomic>
+#include <mutex>
+
+#if !defined(PLATFORM_WEB)
+    #define OUTCOME_PREVIEW_THREADED
+    #include <condition_variable>
+    #include <thread>
+#endif
+
+#define PREVIEW_SEED_COUNT      256
+#define PREVIEW_MAX_TURNS       200         // 打這麼多回合還沒結束就當作打不完 (不算贏)
+#define PREVIEW_FRAME_BUDGET    0.004       // 沒有執行緒時每幀最多花的時間 (秒)
+
+typedef struct OutcomeEstimate {
+    unsigned int generation;            // 屬於哪一次 RequestOutcomePreview
+    int runs;                           // 已打完的場數
+    int wins;                           // 藍隊獲勝
+    int finished;                       // PREVIEW_MAX_TURNS 內分出勝負的場數
+    long long totalTicks;               // finished 場次的結束時間總和
+} OutcomeEstimate;
+
+typedef struct OutcomePreview {
+    const LineOfSightTable *lineOfSight;
+    const int *walls;
+    int width;
+    int height;
+
+    std::atomic<unsigned int> generation;   // 最新一次要求的編號, 模擬中途會讀
+    std::mutex mutex;                       // 保護 units 與 estimate
+    UnitStore units;                        // 最新的配置
+    OutcomeEstimate estimate;
+
+#if defined(OUTCOME_PREVIEW_THREADED)
+    std::condition_variable wake;
+    std::thread worker;
+    bool quit;
+#else
+    int nextSeed;
+#endif
+} OutcomePreview;
+
+// lineOfSight / walls 在 StopOutcomePreview 之前都必須有效且不變
+void StartOutcomePreview(OutcomePreview *preview, const LineOfSightTable *lineOfSight, const int *walls, int width, int height);
+
+// 放棄還在打的那場並等 worker 結束; 不再需要預覽 (開打或離開 SETUP) 時呼叫, 重複呼叫沒有影響
+void StopOutcomePreview(OutcomePreview *preview);
+
+// 配置改變: 放棄還在算的舊配置, 開始估計 units
+void RequestOutcomePreview(OutcomePreview *preview, const UnitStore *units);
+
+// 沒有執行緒時每幀呼叫一次, 在時間預算內推進模擬; 有執行緒時什麼都不做
+void UpdateOutcomePreview(OutcomePreview *preview);
+
+// 最新配置目前的估計 (runs 會隨時間增加到 PREVIEW_SEED_COUNT)
+OutcomeEstimate GetOutcomeEstimate(OutcomePreview *preview);
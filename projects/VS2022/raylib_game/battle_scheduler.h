@@ -0,0 +1,80 @@
+﻿/**********************************************************************************************
+*   Battle action scheduler (discrete-event, binary min-heap)
+*
+*   每個單位只有一個待執行的行動事件, 依下次行動時間排序; 只喚醒時間到的單位,
+*   工作量與行動次數成正比, 而不是 單位數 x tick 數
+*
+*   時間以整數 tick 計算 (速度 1 = 每回合 SCHEDULER_TICKS_PER_TURN tick 行動一次),
+*   同時間的事件依排入順序 (seq) 執行, 同樣的初始狀態一定得到同樣的結果
+*   陣亡單位的事件不主動刪除, 取出時以 UnitHandle 失效判斷後丟棄
+**********************************************************************************************/
+
+#pragma once
+#include "battle_units.h"
+
+#define SCHEDULER_TICKS_PER_TURN    60
+
+typedef struct ScheduledAction {
+    int time;               // 行動時間 (tick)
+    unsigned int seq;       // 同時間時的先後順序
+    UnitHandle unit;
+} ScheduledAction;
+
+typedef struct ActionScheduler {
+    int count;
+    unsigned int nextSeq;
+    ScheduledAction heap[MAX_BATTLE_UNITS];
+} ActionScheduler;
+
+inline int GetActionInterval(int speed)
+{
+    return (speed > 1)? SCHEDULER_TICKS_PER_TURN/speed : SCHEDULER_TICKS_PER_TURN;
+}
+
+inline bool ActionBefore(const ScheduledAction *a, const ScheduledAction *b)
+{
+    return (a->time != b->time)? (a->time < b->time) : (a->seq < b->seq);
+}
+
+inline void InitActionScheduler(ActionScheduler *scheduler)
+{
+    scheduler->count = 0;
+    scheduler->nextSeq = 0;
+}
+
+inline void ScheduleAction(ActionScheduler *scheduler, UnitHandle unit, int time)
+{
+    if (scheduler->count >= MAX_BATTLE_UNITS) return;   // 每個單位最多一個事件, 不會滿
+
+    int i = scheduler->count++;
+    ScheduledAction action = { time, scheduler->nextSeq++, unit };
+    while (i > 0)
+    {
+        int parent = (i - 1)/2;
+        if (!ActionBefore(&action, &scheduler->heap[parent])) break;
+        scheduler->heap[i] = scheduler->heap[parent];
+        i = parent;
+    }
+    scheduler->heap[i] = action;
+}
+
+// 取出最早一個 time <= until 的事件, 沒有則回傳 false
+inline bool PopDueAction(ActionScheduler *scheduler, int until, ScheduledAction *out)
+{
+    if ((scheduler->count == 0) || (scheduler->heap[0].time > until)) return false;
+
+    *out = scheduler->heap[0];
+    ScheduledAction last = scheduler->heap[--scheduler->count];
+    int i = 0;
+    while (true)
+    {
+        int child = 2*i + 1;
+        if (child >= scheduler->count) break;
+        if ((child + 1 < scheduler->count) && ActionBefore(&scheduler->heap[child + 1], &scheduler->heap[child])) child++;
+        if (!ActionBefore(&scheduler->heap[child], &last)) break;
+        scheduler->heap[i] = scheduler->heap[child];
+        i = child;
+    }
+    if (scheduler->count > 0) scheduler->heap[i] = last;
+    return true;
+}
@@ -0,0 +1,199 @@
+﻿/**********************************************************************************************
+*   Headless setup battle
+**********************************************************************************************/
+
+#include "battle_setup_sim.h"
+#include "battle_engine.h"
+#include "battle_terrain.h"
+#include <stdlib.h>
+
+static bool IsSetupCellBlocked(const SetupBattle *battle, int x, int y)
+{
+    if (x < 0 || x >= battle->width || y < 0 || y >= battle->height) return true;
+    if (!IsTerrainWalkable(battle->walls[y*battle->width + x])) return true;
+    return FindUnitAt(&battle->units, x, y) >= 0;
+}
+
+// 只考慮牆的 BFS (4 方向), 回傳從 from 往 to 的第一步, 到不了回傳 -1
+static int FindSetupDetourStep(const SetupBattle *battle, int from, int to)
+{
+    static const int dirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
+    int width = battle->width;
+    int cells = width*battle->height;
+    int queue[LOS_MAX_CELLS];
+    int parent[LOS_MAX_CELLS];
+    for (int c = 0; c < cells; c++) parent[c] = -2;
+
+    int head = 0, tail = 0;
+    queue[tail++] = to;             // 從目標往回搜, 走到 from 時的 parent 就是第一步
+    parent[to] = -1;
+    while (head < tail)
+    {
+        int cur = queue[head++];
+        for (int i = 0; i < 4; i++)
+        {
+            int nx = cur%width + dirs[i][0];
+            int ny = cur/width + dirs[i][1];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= battle->height) continue;
+            int next = ny*width + nx;
+            if ((parent[next] != -2) || !IsTerrainWalkable(battle->walls[next])) continue;
+            parent[next] = cur;
+            if (next == from) return cur;
+            queue[tail++] = next;
+        }
+    }
+    return -1;
+}
+
+// 朝目標直走一步 (可斜走); 被牆擋住時改走繞過牆的最短路, 被單位擋住就原地不動
+static SetupAction GetSetupStepTowards(const SetupBattle *battle, int u, int target)
+{
+    const UnitStore *units = &battle->units;
+    SetupAction stay = { -1, units->x[u], units->y[u] };
+    int dx = units->x[target] - units->x[u];
+    int dy = units->y[target] - units->y[u];
+    int stepX = (dx != 0)? dx/abs(dx) : 0;
+    int stepY = (dy != 0)? dy/abs(dy) : 0;
+    int nx = units->x[u] + stepX;
+    int ny = units->y[u] + stepY;
+    if (!IsTerrainWalkable(battle->walls[ny*battle->width + nx]))
+    {
+        int step = FindSetupDetourStep(battle, units->y[u]*battle->width + units->x[u], units->y[target]*battle->width + units->x[target]);
+        if (step < 0) return stay;
+        nx = step%battle->width;
+        ny = step/battle->width;
+    }
+    if (IsSetupCellBlocked(battle, nx, ny)) return stay;
+    return SetupAction{ -1, nx, ny };
+}
+
+// 直走一步, 沒有偵察 (整個棋盤都看得到) 也沒有預約
+// 刻意不用 GAMEPLAY 的 CooperativeMovement: SetupBattle 要能整個複製 (MCTS 每次 playout、預覽與陣形搜尋每場模擬),
+// 而預約表 / 距離場 / 視野都是 Init 時配置的 vector, 放進來每次複製都要配置記憶體, 也會慢上一個數量級;
+// 這裡的結果只拿來比較配置的好壞, 不必與實際戰鬥一步一步相同
+struct DirectStepMovement
+{
+    static void Stay(SetupBattle *, int, int, int) { }
+    static void Scout(SetupBattle *, int, int, int) { }
+    static void EndAction(SetupBattle *) { }
+
+    static void Advance(SetupBattle *battle, int u, int enemy, int, int)
+    {
+        SetupAction step = GetSetupStepTowards(battle, u, enemy);
+        battle->units.x[u] = step.x;
+        battle->units.y[u] = step.y;
+    }
+};
+
+typedef BattleEngine<SeededInitiative, FullVisionTargeting, DirectStepMovement> SetupEngine;
+
+static Fixed GetSetupTotalHP(const UnitStore *units)
+{
+    Fixed total = 0;
+    for (int t = 0; t < TEAM_COUNT; t++)
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(units, (Team)t); i++) total += units->hp[i];
+    return total;
+}
+
+void StartSetupBattle(SetupBattle *battle, const UnitStore *units, const LineOfSightTable *lineOfSight,
+    const int *walls, int width, int height, unsigned int seed)
+{
+    battle->units = *units;
+    battle->lineOfSight = lineOfSight;
+    battle->walls = walls;
+    battle->width = width;
+    battle->height = height;
+    battle->rng = (seed != 0)? seed : 1;
+    SetupEngine::Start(battle);
+
+    ClearRepetitionTable(&battle->repetitions);
+    battle->totalHP = GetSetupTotalHP(&battle->units);
+    battle->stalemate = false;
+}
+
+bool PopSetupAction(SetupBattle *battle, int untilTime, ScheduledAction *out)
+{
+    return SetupEngine::Pop(battle, untilTime, out);
+}
+
+SetupAction GetDefaultSetupAction(const SetupBattle *battle, int u)
+{
+    BehaviorDecision decision = SetupEngine::Decide(battle, u);
+    if (decision.command == BEHAVIOR_ATTACK) return SetupAction{ decision.target, 0, 0 };
+    if (decision.command == BEHAVIOR_ADVANCE) return GetSetupStepTowards(battle, u, decision.target);
+    return SetupAction{ -1, battle->units.x[u], battle->units.y[u] };
+}
+
+int ListSetupActions(const SetupBattle *battle, int u, SetupAction *out)
+{
+    const UnitStore *units = &battle->units;
+    int count = 0;
+
+    // 射程內看得到的每個敵人
+    const CellMask *visible = &battle->lineOfSight->visible[units->y[u]*battle->width + units->x[u]];
+    Team enemyTeam = GetEnemyTeam(GetUnitTeam(u));
+    for (int e = GetTeamBegin(enemyTeam); e < GetTeamEnd(units, enemyTeam); e++)
+    {
+        int d = abs(units->x[e] - units->x[u]) + abs(units->y[e] - units->y[u]);
+        if ((d <= units->range[u]) && GetCellMaskBit(visible, units->y[e]*battle->width + units->x[e])) out[count++] = SetupAction{ e, 0, 0 };
+    }
+
+    // 原地等待 + 8 個方向中沒被擋住的格子
+    out[count++] = SetupAction{ -1, units->x[u], units->y[u] };
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            int nx = units->x[u] + dx;
+            int ny = units->y[u] + dy;
+            if (((dx != 0) || (dy != 0)) && !IsSetupCellBlocked(battle, nx, ny)) out[count++] = SetupAction{ -1, nx, ny };
+        }
+    }
+    return count;
+}
+
+void ApplySetupAction(SetupBattle *battle, const ScheduledAction *action, SetupAction choice)
+{
+    int u = GetUnitIndex(&battle->units, action->unit);
+    if (choice.target >= 0) FullVisionTargeting::Strike(battle, u, choice.target);
+    else
+    {
+        battle->units.x[u] = choice.x;
+        battle->units.y[u] = choice.y;
+    }
+    SetupEngine::Finish(battle, action, GetActionInterval(battle->units.speed[u]));
+}
+
+bool StepSetupBattle(SetupBattle *battle, int untilTime)
+{
+    ScheduledAction action;
+    while (SetupEngine::Pop(battle, untilTime, &action))
+    {
+        SetupEngine::Resolve(battle, &action);
+        CheckSetupStalemate(battle, &action);
+    }
+    return battle->over;
+}
+
+// 狀態 = 位置 + hp + 剛行動的是誰 + 排程, 同 GAMEPLAY (這裡沒有預約表); 戰場很小, 每次整個重算
+bool CheckSetupStalemate(SetupBattle *battle, const ScheduledAction *action)
+{
+    if (battle->over) return true;
+
+    Fixed totalHP = GetSetupTotalHP(&battle->units);
+    if (totalHP != battle->totalHP)
+    {
+        ClearRepetitionTable(&battle->repetitions);     // hp 只會減少, 之前的狀態不會再出現
+        battle->totalHP = totalHP;
+    }
+
+    uint64_t state = ComputeZobristHash(&battle->units, battle->width) ^ MixZobristKey(action->unit) ^ GetZobristSchedulerKey(&battle->scheduler, action->time);
+    if (RecordRepetition(&battle->repetitions, state) >= STALEMATE_REPETITIONS)
+    {
+        battle->over = true;
+        battle->stalemate = true;
+        battle->winner = GetStalemateWinner(&battle->units);
+        battle->endTime = action->time;
+    }
+    return battle->over;
+}
@@ -0,0 +1,72 @@
+﻿/**********************************************************************************************
+*   Headless setup battle
+*
+*   SETUP 畫面的戰鬥: battle_engine.h 以 SeededInitiative + FullVisionTargeting + 直走一步的移動組合而成,
+*   每個單位照兵種的 behavior tree 決定攻擊或往最近的敵人走一步 (可斜走, 被牆擋住才繞路);
+*   整場狀態都放在 SetupBattle 裡, 不碰任何全域變數, 可以同時在多個執行緒各跑一場
+*
+*   開場先攻: 每個單位第一次行動落在第一個行動間隔內的隨機 tick (由 seed 決定),
+*   同樣的配置與 seed 一定得到同樣的結果; 換 seed 就是換一種先攻順序
+*
+*   StepSetupBattle 讓每個單位都用預設 (behavior tree) 的行動; 要替某些單位另外做決定時,
+*   自己用 PopSetupAction 取出行動、從 ListSetupActions 挑一個, 再交給 ApplySetupAction
+*
+*   StepSetupBattle 同 GAMEPLAY 偵測僵局 (battle_zobrist.h): 位置 + hp + 排程重複 STALEMATE_REPETITIONS 次就結束,
+*   勝負由 GetStalemateWinner 決定; 自己逐一執行行動時, 每次 ApplySetupAction 之後呼叫 CheckSetupStalemate
+**********************************************************************************************/
+
+#pragma once
+#include "battle_units.h"
+#include "battle_scheduler.h"
+#include "battle_los.h"
+#include "battle_behavior.h"
+#include "battle_zobrist.h"
+
+#define SETUP_MAX_ACTIONS   (MAX_TEAM_UNITS + 9)     // 攻擊每個敵人 + 原地 + 8 方向
+
+// 一次行動: target >= 0 攻擊該 dense index 的單位, 否則移動到 (x, y) (等於原位 = 原地等待)
+typedef struct SetupAction {
+    int target;
+    int x;
+    int y;
+} SetupAction;
+
+typedef struct SetupBattle {
+    UnitStore units;
+    ActionScheduler scheduler;
+    const LineOfSightTable *lineOfSight;
+    const int *walls;                   // 同 grid[][], 只讀
+    int width;
+    int height;
+
+    unsigned int rng;                   // xorshift32 狀態
+    bool over;
+    Team winner;
+    int endTime;                        // 分出勝負的 tick
+
+    RepetitionTable repetitions;        // 上次有人受傷後出現過的狀態
+    Fixed totalHP;                      // 兩隊 hp 總和, 變少代表有人受傷
+    bool stalemate;                     // 因僵局結束, winner 由總 hp 決定
+} SetupBattle;
+
+// 複製 units 當作開場, 依 seed 排入每個單位的第一次行動 (seed 0 視為 1)
+void StartSetupBattle(SetupBattle *battle, const UnitStore *units, const LineOfSightTable *lineOfSight,
+    const int *walls, int width, int height, unsigned int seed);
+
+// 以預設行動執行所有 time <= untilTime 的行動, 回傳戰鬥是否已結束
+bool StepSetupBattle(SetupBattle *battle, int untilTime);
+
+// 取出下一個 time <= untilTime 且單位還活著的行動; 沒有或戰鬥已結束回傳 false
+bool PopSetupAction(SetupBattle *battle, int untilTime, ScheduledAction *out);
+
+// 預設行動: 兵種的 behavior tree, 敵人以曼哈頓距離找最近的 (不執行)
+SetupAction GetDefaultSetupAction(const SetupBattle *battle, int u);
+
+// 單位 u 所有合法的行動 (最多 SETUP_MAX_ACTIONS 個), 預設行動一定在其中
+int ListSetupActions(const SetupBattle *battle, int u, SetupAction *out);
+
+// 執行 PopSetupAction 取出的行動, 排入該單位下一次行動並檢查勝負
+void ApplySetupAction(SetupBattle *battle, const ScheduledAction *action, SetupAction choice);
+
+// 記錄 action 執行後的狀態; 同一個狀態出現 STALEMATE_REPETITIONS 次就以僵局結束, 回傳戰鬥是否已結束
+bool CheckSetupStalemate(SetupBattle *battle, const ScheduledAction *action);
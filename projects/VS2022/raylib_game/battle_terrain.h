@@ -0,0 +1,38 @@
+﻿/**********************************************************************************************
+*   Battle terrain
+*
+*   grid[][] 的值就是地形種類; 0 / 1 維持原本的 空地 / 障礙, 其他地形只影響移動成本
+*   成本以 1/3 步為單位: 空地 3, 道路 2 (比空地快 1.5 倍), 高地 6, 泥地 9;
+*   道路只有一條, 給到兩倍快時全隊會擠在道路上排隊, 戰鬥反而變長
+*   要換回「步數」的地方 (例如 behavior tree 的 ENEMY_WITHIN) 除以 TERRAIN_FLOOR_COST
+*   成本是小整數 (1 ~ TERRAIN_MAX_COST), 有加權地形時尋路用 bucket queue (battle_bucket_queue.h)
+**********************************************************************************************/
+
+#pragma once
+
+typedef enum {
+    TERRAIN_FLOOR = 0,
+    TERRAIN_WALL = 1,
+    TERRAIN_MUD,
+    TERRAIN_ROAD,
+    TERRAIN_HIGH_GROUND,
+    TERRAIN_COUNT
+} TerrainType;
+
+#define TERRAIN_FLOOR_COST  3
+#define TERRAIN_MAX_COST    9
+
+// 進入該格的成本, 牆不能進入 (0)
+inline int GetTerrainCost(int terrain)
+{
+    static const int costs[TERRAIN_COUNT] = {
+        3,      // TERRAIN_FLOOR
+        0,      // TERRAIN_WALL
+        9,      // TERRAIN_MUD
+        2,      // TERRAIN_ROAD
+        6,      // TERRAIN_HIGH_GROUND
+    };
+    return costs[terrain];
+}
+
+inline bool IsTerrainWalkable(int terrain) { return terrain != TERRAIN_WALL; }
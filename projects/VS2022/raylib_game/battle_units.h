@@ -0,0 +1,149 @@
+﻿/**********************************************************************************************
+*   Battle unit storage (structure-of-arrays)
+*
+*   每個欄位各自一條連續陣列, 各隊存活單位固定放在自己的連續區段:
+*       team t -> dense index [t*MAX_TEAM_UNITS, t*MAX_TEAM_UNITS + count[t])
+*   死亡單位由 CompactUnits 以 swap-remove 移除, 區段內永遠只有活著的單位,
+*   所以統計、存活判斷都是對連續區段的簡單迴圈 (可被編譯器向量化)
+*
+*   hp / attack 是 Fixed (battle_fixed.h), 戰鬥結算全部是整數運算
+*   dense index 會因 compaction 改變, 需要跨回合保存的參照 (目標、排程) 請用 UnitHandle
+**********************************************************************************************/
+
+#pragma once
+#include "game_unit.h"
+#include "battle_fixed.h"
+
+#define MAX_TEAM_UNITS      32
+#define MAX_BATTLE_UNITS    (MAX_TEAM_UNITS*TEAM_COUNT)
+#define INVALID_UNIT_HANDLE 0xffffffffu
+
+typedef enum { TEAM_RED = 0, TEAM_BLUE, TEAM_COUNT } Team;
+
+typedef unsigned int UnitHandle;    // (generation << 16) | slot
+
+typedef struct UnitStore {
+    int count[TEAM_COUNT];                      // 各隊存活數
+
+    // SoA 欄位 (dense index)
+    int x[MAX_BATTLE_UNITS];
+    int y[MAX_BATTLE_UNITS];
+    Fixed hp[MAX_BATTLE_UNITS];
+    Fixed attack[MAX_BATTLE_UNITS];
+    int speed[MAX_BATTLE_UNITS];
+    int range[MAX_BATTLE_UNITS];
+    int type[MAX_BATTLE_UNITS];                 // GameData::AllUnits index
+    UnitHandle handle[MAX_BATTLE_UNITS];
+
+    // handle slot -> dense index, 每次釋放 slot 時 generation + 1 讓舊 handle 失效
+    int dense[MAX_BATTLE_UNITS];
+    unsigned short generation[MAX_BATTLE_UNITS];
+} UnitStore;
+
+inline int GetTeamBegin(Team team) { return (int)team*MAX_TEAM_UNITS; }
+inline int GetTeamEnd(const UnitStore *store, Team team) { return (int)team*MAX_TEAM_UNITS + store->count[team]; }
+inline Team GetUnitTeam(int index) { return (Team)(index/MAX_TEAM_UNITS); }
+inline Team GetEnemyTeam(Team team) { return (team == TEAM_RED)? TEAM_BLUE : TEAM_RED; }
+
+inline void InitUnitStore(UnitStore *store)
+{
+    for (int t = 0; t < TEAM_COUNT; t++) store->count[t] = 0;
+    for (int i = 0; i < MAX_BATTLE_UNITS; i++)
+    {
+        store->dense[i] = -1;
+        store->generation[i] = 0;
+    }
+}
+
+// 新增單位, slot 與該隊的 dense 區段一一對應 (同隊只會用同隊的 slot), 滿了回傳 INVALID_UNIT_HANDLE
+inline UnitHandle AddUnit(UnitStore *store, Team team, int x, int y, Fixed hp, Fixed attack, int speed, int range, int type)
+{
+    if (store->count[team] >= MAX_TEAM_UNITS) return INVALID_UNIT_HANDLE;
+
+    int slot = -1;
+    for (int s = GetTeamBegin(team); s < GetTeamBegin(team) + MAX_TEAM_UNITS; s++)
+    {
+        if (store->dense[s] < 0) { slot = s; break; }
+    }
+
+    int i = GetTeamEnd(store, team);
+    store->count[team]++;
+    store->x[i] = x;
+    store->y[i] = y;
+    store->hp[i] = hp;
+    store->attack[i] = attack;
+    store->speed[i] = speed;
+    store->range[i] = range;
+    store->type[i] = type;
+    store->handle[i] = ((UnitHandle)store->generation[slot] << 16) | (UnitHandle)slot;
+    store->dense[slot] = i;
+
+    return store->handle[i];
+}
+
+// 依兵種資料表 (GameData::AllUnits) 的等級數值新增單位; 速度與射程四捨五入成整數
+inline UnitHandle AddCatalogUnit(UnitStore *store, Team team, int x, int y, int type, int level)
+{
+    return AddUnit(store, team, x, y, GameData::GetUnitHp(type, level), GameData::GetUnitAtk(type, level),
+        FixedRoundToInt(GameData::GetUnitSpd(type, level)), FixedRoundToInt(GameData::GetUnitRange(type, level)), type);
+}
+
+// handle -> 目前 dense index, 單位已被移除則回傳 -1
+inline int GetUnitIndex(const UnitStore *store, UnitHandle handle)
+{
+    if (handle == INVALID_UNIT_HANDLE) return -1;
+    int slot = (int)(handle & 0xffff);
+    if (store->generation[slot] != (unsigned short)(handle >> 16)) return -1;
+    return store->dense[slot];
+}
+
+// 移除 hp <= 0 的單位: 把該隊最後一個搬進空位 (swap-remove), 區段保持連續
+inline void CompactUnits(UnitStore *store)
+{
+    for (int t = 0; t < TEAM_COUNT; t++)
+    {
+        int i = GetTeamBegin((Team)t);
+        while (i < GetTeamEnd(store, (Team)t))
+        {
+            if (store->hp[i] > 0) { i++; continue; }
+
+            int deadSlot = (int)(store->handle[i] & 0xffff);
+            store->dense[deadSlot] = -1;
+            store->generation[deadSlot]++;
+
+            int last = GetTeamEnd(store, (Team)t) - 1;
+            if (i != last)
+            {
+                store->x[i] = store->x[last];
+                store->y[i] = store->y[last];
+                store->hp[i] = store->hp[last];
+                store->attack[i] = store->attack[last];
+                store->speed[i] = store->speed[last];
+                store->range[i] = store->range[last];
+                store->type[i] = store->type[last];
+                store->handle[i] = store->handle[last];
+                store->dense[store->handle[i] & 0xffff] = i;
+            }
+            store->count[t]--;
+        }
+    }
+}
+
+// 某格是否有 (hp > 0 的) 單位, 回傳 dense index 或 -1
+inline int FindUnitAt(const UnitStore *store, int x, int y)
+{
+    for (int t = 0; t < TEAM_COUNT; t++)
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(store, (Team)t); i++)
+            if ((store->hp[i] > 0) && (store->x[i] == x) && (store->y[i] == y)) return i;
+    return -1;
+}
+
+// 存活數與總血量: 區段內都是活的單位, 直接加總
+inline void GetUnitTeamStats(const UnitStore *store, Team team, int *aliveCount, Fixed *totalHP)
+{
+    Fixed sum = 0;
+    const Fixed *hp = store->hp;
+    for (int i = GetTeamBegin(team); i < GetTeamEnd(store, team); i++) sum += hp[i];
+    *aliveCount = store->count[team];
+    *totalHP = sum;
+}
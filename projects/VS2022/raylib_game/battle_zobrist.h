@@ -0,0 +1,115 @@
+﻿/**********************************************************************************************
+*   Battle state hashing (Zobrist) and repetition detection
+*
+*   戰場狀態的 hash = 每個存活單位 key(handle, 格子, hp) 的 XOR
+*   單位移動、受傷、陣亡時只要把舊的 key XOR 掉、新的 XOR 進去, 不用重算整個戰場
+*   key 不查表, 由 slot / 格子 / hp 各佔不重疊的位元 (16 / 16 / 32) 再經 SplitMix64 混合而成:
+*   格子數與 slot 數都要小於 65536 (LOS_MAX_CELLS, MAX_BATTLE_UNITS 遠小於此), hp 用完整的 32 bits
+*
+*   位置 + hp 相同但排程不同 (某個單位晚一點才行動) 時之後的發展也不同, 不能算重複:
+*   判斷僵局時再 XOR 上 GetZobristSchedulerKey (每個待執行行動距現在幾 tick), 有預約表的話也要加上預約
+*
+*   RepetitionTable 記錄上次有人受傷之後出現過的狀態 (open addressing):
+*   hp 只會減少, 有人受傷後之前的狀態不可能再出現, 表可以直接清空
+*   同一個狀態出現 STALEMATE_REPETITIONS 次就視為僵局 (單位來回擺盪, 永遠打不完)
+**********************************************************************************************/
+
+#pragma once
+#include <stdint.h>
+#include "battle_units.h"
+#include "battle_scheduler.h"
+
+#define REPETITION_TABLE_SIZE   256     // 2 的次方
+#define STALEMATE_REPETITIONS   3
+#define ZOBRIST_SCHEDULER_SALT  0x5bd1e9955bd1e995ull     // 讓排程的 key 與單位的 key 不會剛好相同
+
+inline uint64_t MixZobristKey(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// 只取 handle 的 slot: 同一個 slot 同時只有一個存活單位, 換人之前一定有人陣亡, 重複表早已清空, 不需要 generation
+inline uint64_t GetZobristUnitKey(UnitHandle handle, int cell, int hp)
+{
+    return MixZobristKey(((uint64_t)(handle & 0xffff) << 48) | ((uint64_t)(unsigned int)cell << 32) | (uint64_t)(uint32_t)hp);
+}
+
+// 單位 (handle) 在 cell 且有 hp 的狀態加入 / 移出 hash (XOR, 兩者相同)
+inline void ToggleZobristUnit(uint64_t *hash, UnitHandle handle, int cell, int hp)
+{
+    *hash ^= GetZobristUnitKey(handle, cell, hp);
+}
+
+// 整個戰場重算一次, 只在開場使用
+inline uint64_t ComputeZobristHash(const UnitStore *store, int width)
+{
+    uint64_t hash = 0;
+    for (int t = 0; t < TEAM_COUNT; t++)
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(store, (Team)t); i++)
+            ToggleZobristUnit(&hash, store->handle[i], store->y[i]*width + store->x[i], store->hp[i]);
+    return hash;
+}
+
+// 排程狀態: 每個待執行行動 (單位, 距 now 幾 tick) 的 key 的 XOR; 同 tick 的先後由排入順序決定, 不另外計入
+// 已陣亡單位的事件還留在 heap 裡, 但 handle 已失效, 位置 hash 不同, 不會讓兩個不同的狀態相撞
+inline uint64_t GetZobristSchedulerKey(const ActionScheduler *scheduler, int now)
+{
+    uint64_t key = 0;
+    for (int k = 0; k < scheduler->count; k++)
+    {
+        const ScheduledAction *action = &scheduler->heap[k];
+        key ^= MixZobristKey((((uint64_t)action->unit << 32) | (uint64_t)(unsigned int)(action->time - now)) ^ ZOBRIST_SCHEDULER_SALT);
+    }
+    return key;
+}
+
+// 僵局時的勝負: 總 hp 高的一方獲勝, 再比存活數, 都相同算藍隊 (玩家) 贏
+inline Team GetStalemateWinner(const UnitStore *store)
+{
+    int redAlive, blueAlive;
+    Fixed redHP, blueHP;
+    GetUnitTeamStats(store, TEAM_RED, &redAlive, &redHP);
+    GetUnitTeamStats(store, TEAM_BLUE, &blueAlive, &blueHP);
+
+    if (redHP != blueHP) return (redHP > blueHP)? TEAM_RED : TEAM_BLUE;
+    if (redAlive != blueAlive) return (redAlive > blueAlive)? TEAM_RED : TEAM_BLUE;
+    return TEAM_BLUE;
+}
+
+typedef struct RepetitionTable {
+    uint64_t hash[REPETITION_TABLE_SIZE];
+    unsigned char count[REPETITION_TABLE_SIZE];     // 0 = 空位
+    int used;
+} RepetitionTable;
+
+inline void ClearRepetitionTable(RepetitionTable *table)
+{
+    for (int i = 0; i < REPETITION_TABLE_SIZE; i++) table->count[i] = 0;
+    table->used = 0;
+}
+
+// 記錄一次 hash, 回傳它至今出現的次數
+// 表用到 3/4 就清空重來: 很久沒人受傷但狀態一直在變, 不是擺盪
+inline int RecordRepetition(RepetitionTable *table, uint64_t hash)
+{
+    if (table->used >= REPETITION_TABLE_SIZE*3/4) ClearRepetitionTable(table);
+
+    int i = (int)(hash & (REPETITION_TABLE_SIZE - 1));
+    while (table->count[i] > 0)
+    {
+        if (table->hash[i] == hash)
+        {
+            if (table->count[i] < 255) table->count[i]++;
+            return table->count[i];
+        }
+        i = (i + 1) & (REPETITION_TABLE_SIZE - 1);
+    }
+
+    table->hash[i] = hash;
+    table->count[i] = 1;
+    table->used++;
+    return 1;
+}
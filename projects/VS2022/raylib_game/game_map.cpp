@@ -0,0 +1,396 @@
+﻿/**********************************************************************************************
+*   Game Map DAG (compressed-sparse-row storage)
+**********************************************************************************************/
+
+#include "game_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+#include <new>
+
+//---------------------------------------------------------------------------
+// Blob format: header + level[n] + edgeOffset[n + 1] + edges[e] + labelOffset[n] + labelPool[p]
+//---------------------------------------------------------------------------
+#define GAME_MAP_BLOB_MAGIC     0x50414d47  // "GMAP"
+#define GAME_MAP_BLOB_VERSION   1
+
+typedef struct GameMapBlobHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t poolSize;
+} GameMapBlobHeader;
+
+//---------------------------------------------------------------------------
+// Deterministic per-level generation
+//---------------------------------------------------------------------------
+// splitmix32 風格的 hash, 讓每層有獨立且可重現的亂數序列
+static uint32_t HashLevel(uint32_t seed, uint32_t depth, uint32_t salt)
+{
+    uint32_t h = seed ^ (depth*0x9e3779b9u) ^ (salt*0x85ebca6bu);
+    h ^= h >> 16; h *= 0x7feb352du;
+    h ^= h >> 15; h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+static int GetLevelWidth(uint32_t seed, int depth, int totalLevels, int maxPathsPerNode)
+{
+    if (depth == 0) return 1;                                       // Root
+    if (depth == totalLevels - 1) return 2 + HashLevel(seed, depth, 0) % 3;   // 結局 2 ~ 4 個
+    if (depth == 1) return 1 + HashLevel(seed, depth, 0) % maxPathsPerNode;
+    return 2 + HashLevel(seed, depth, 0) % (GAME_MAP_MAX_WIDTH - 1);
+}
+
+// 依比例把下一層切給這層每個 node (保證每個 node 都有路、下一層每個 node 都走得到, 邊不交叉),
+// 再隨機多連一條到右邊鄰居的第一個 node 形成共用節點
+static void GenerateLevelEdges(uint32_t seed, int depth, int attempt, int nextCount, int maxPathsPerNode, GameMapLevel *out)
+{
+    int edgeCount = 0;
+    for (int i = 0; i < out->nodeCount; i++)
+    {
+        out->edgeOffset[i] = edgeCount;
+        if (nextCount == 0) continue;
+
+        int lo = i*nextCount/out->nodeCount;
+        int hi = ((i + 1)*nextCount + out->nodeCount - 1)/out->nodeCount - 1;
+        if (hi < lo) hi = lo;
+        if ((hi + 1 < nextCount) && (hi - lo + 1 < maxPathsPerNode) && (HashLevel(seed, depth, 1 + i + attempt*GAME_MAP_MAX_WIDTH) % 3 == 0)) hi++;
+
+        for (int c = lo; c <= hi; c++) out->edges[edgeCount++] = c;
+    }
+    out->edgeOffset[out->nodeCount] = edgeCount;
+}
+
+// 退化層: 下一層同寬且沒有任何分岔, 通過這層後 root 路徑總數不變 (玩家沒有選擇)
+static bool IsCorridorLevel(const GameMapLevel *level, int nextCount)
+{
+    return (nextCount == level->nodeCount) && (level->edgeOffset[level->nodeCount] == level->nodeCount);
+}
+
+void GenerateGameMapLevel(unsigned int seed, int depth, int totalLevels, int maxPathsPerNode, GameMapLevel *out)
+{
+    memset(out, 0, sizeof(GameMapLevel));   // 未用到的欄位也清零, 同一層重產生會 byte-identical
+    out->depth = depth;
+    out->nodeCount = GetLevelWidth(seed, depth, totalLevels, maxPathsPerNode);
+
+    int nextCount = (depth + 1 < totalLevels)? GetLevelWidth(seed, depth + 1, totalLevels, maxPathsPerNode) : 0;
+
+    // 重抽次數也只由 (seed, depth) 決定, 所以仍可重現
+    for (int attempt = 0; attempt < GAME_MAP_MAX_REJECTS; attempt++)
+    {
+        GenerateLevelEdges(seed, depth, attempt, nextCount, maxPathsPerNode, out);
+        if (!IsCorridorLevel(out, nextCount)) break;
+    }
+}
+
+static void AppendLevelLabel(GameMap *map, int depth, int slot, int totalLevels)
+{
+    char text[32] = { 0 };
+    if (depth == 0) snprintf(text, sizeof(text), "Root");
+    else if (depth == totalLevels - 1) snprintf(text, sizeof(text), "Ending %c", GetGameMapEndingLetter(slot));
+    else snprintf(text, sizeof(text), "Path %i-%i", depth, slot + 1);
+
+    map->labelOffset.push_back((int)map->labelPool.size());
+    map->labelPool.insert(map->labelPool.end(), text, text + strlen(text) + 1);
+}
+
+// 把 ring 中 window 內的層展開成 CSR, 層依 depth 排序所以 local index 連續
+static void BuildStreamWindow(GameMapStream *stream)
+{
+    GameMap *map = &stream->map;
+    map->level.clear();
+    map->edgeOffset.clear();
+    map->edges.clear();
+    map->labelOffset.clear();
+    map->labelPool.clear();
+
+    int levelStart[GAME_MAP_WINDOW + 1] = { 0 };
+    for (int d = stream->firstDepth; d <= stream->lastDepth; d++)
+    {
+        const GameMapLevel *lvl = &stream->ring[d % GAME_MAP_WINDOW];
+        levelStart[d - stream->firstDepth] = GetGameMapNodeCount(map);
+        for (int slot = 0; slot < lvl->nodeCount; slot++)
+        {
+            map->level.push_back(stream->totalLevels - 1 - d);
+            AppendLevelLabel(map, d, slot, stream->totalLevels);
+        }
+    }
+
+    for (int d = stream->firstDepth; d <= stream->lastDepth; d++)
+    {
+        const GameMapLevel *lvl = &stream->ring[d % GAME_MAP_WINDOW];
+        bool nextResident = (d < stream->lastDepth);
+        int nextStart = nextResident? levelStart[d + 1 - stream->firstDepth] : 0;
+        for (int slot = 0; slot < lvl->nodeCount; slot++)
+        {
+            map->edgeOffset.push_back((int)map->edges.size());
+            if (!nextResident) continue;    // 還沒產生的下一層先不連
+            for (int e = lvl->edgeOffset[slot]; e < lvl->edgeOffset[slot + 1]; e++) map->edges.push_back(nextStart + lvl->edges[e]);
+        }
+    }
+    map->edgeOffset.push_back((int)map->edges.size());
+}
+
+static unsigned long long AddSaturate(unsigned long long a, unsigned long long b)
+{
+    return (a > ULLONG_MAX - b)? ULLONG_MAX : a + b;
+}
+
+// 新產生的層: root 路徑數 = 上一層所有連進來的路徑數總和
+static void AccumulateLevelPaths(GameMapStream *stream, int depth)
+{
+    unsigned long long *paths = stream->ringPaths[depth % GAME_MAP_WINDOW];
+    memset(paths, 0, sizeof(stream->ringPaths[0]));
+    if (depth == 0) { paths[0] = 1; return; }
+
+    const GameMapLevel *prev = &stream->ring[(depth - 1) % GAME_MAP_WINDOW];
+    const unsigned long long *prevPaths = stream->ringPaths[(depth - 1) % GAME_MAP_WINDOW];
+    for (int slot = 0; slot < prev->nodeCount; slot++)
+        for (int e = prev->edgeOffset[slot]; e < prev->edgeOffset[slot + 1]; e++)
+            paths[prev->edges[e]] = AddSaturate(paths[prev->edges[e]], prevPaths[slot]);
+}
+
+// [first, last] 這段 slot 沿 level 的邊往下一層: 每個 node 連到遞增的一段 slot, 相鄰 node 的範圍相接或重疊,
+// 所以結果仍是一段; 起點 (lo) 隨 node 遞增, 終點因為額外的共用邊不一定遞增, 要取整段的最大值
+static void PushEndingRange(const GameMapLevel *level, int *first, int *last)
+{
+    int hi = level->edges[level->edgeOffset[*first + 1] - 1];
+    for (int slot = *first + 1; slot <= *last; slot++)
+        if (level->edges[level->edgeOffset[slot + 1] - 1] > hi) hi = level->edges[level->edgeOffset[slot + 1] - 1];
+    *first = level->edges[level->edgeOffset[*first]];
+    *last = hi;
+}
+
+static_assert(GAME_MAP_MAX_WIDTH <= 16, "ending ranges are packed into 4-bit slots");
+
+static unsigned char PackEndingRange(int first, int last) { return (unsigned char)(first | (last << 4)); }
+
+// 由結局層往 root 掃一次: 每個 slot 的範圍 = 它往下一層連到的那段 slot 的範圍聯集
+// 每層只重產生一次, 整段旅程 O(總層數); 之後推進 window 只查表
+static void BuildEndingRanges(GameMapStream *stream)
+{
+    int totalLevels = stream->totalLevels;
+    stream->endingRanges.assign((size_t)totalLevels*GAME_MAP_MAX_WIDTH, 0);
+
+    GameMapLevel level;
+    for (int d = totalLevels - 1; d >= 0; d--)
+    {
+        GenerateGameMapLevel(stream->seed, d, totalLevels, stream->maxPathsPerNode, &level);
+        unsigned char *row = &stream->endingRanges[(size_t)d*GAME_MAP_MAX_WIDTH];
+        const unsigned char *next = row + GAME_MAP_MAX_WIDTH;
+        for (int slot = 0; slot < level.nodeCount; slot++)
+        {
+            if (d == totalLevels - 1) { row[slot] = PackEndingRange(slot, slot); continue; }
+
+            int lo = slot, hi = slot;
+            PushEndingRange(&level, &lo, &hi);
+            int first = next[lo] & 15, last = next[lo] >> 4;
+            for (int c = lo + 1; c <= hi; c++)
+            {
+                if ((next[c] & 15) < first) first = next[c] & 15;
+                if ((next[c] >> 4) > last) last = next[c] >> 4;
+            }
+            row[slot] = PackEndingRange(first, last);
+        }
+    }
+}
+
+// window 最深一層每個 slot 可到達的結局範圍 (查 BuildEndingRanges 的表)
+static void ComputeFrontierEndings(const GameMapStream *stream, int first[GAME_MAP_MAX_WIDTH], int last[GAME_MAP_MAX_WIDTH])
+{
+    const unsigned char *row = &stream->endingRanges[(size_t)stream->lastDepth*GAME_MAP_MAX_WIDTH];
+    for (int slot = 0; slot < stream->ring[stream->lastDepth % GAME_MAP_WINDOW].nodeCount; slot++)
+    {
+        first[slot] = row[slot] & 15;
+        last[slot] = row[slot] >> 4;
+    }
+}
+
+// window 內反向掃描: local index 依 depth 遞增, 倒著走時所有 parents 都已算好
+static void AnalyzeStreamWindow(GameMapStream *stream)
+{
+    const GameMap *map = &stream->map;
+    GameMapAnalysis *analysis = &stream->analysis;
+    int nodeCount = GetGameMapNodeCount(map);
+
+    analysis->pathsFromRoot.resize(nodeCount);
+    analysis->firstEnding.resize(nodeCount);
+    analysis->lastEnding.resize(nodeCount);
+    analysis->reachMask.resize(nodeCount);
+
+    int frontierFirst[GAME_MAP_MAX_WIDTH], frontierLast[GAME_MAP_MAX_WIDTH];
+    ComputeFrontierEndings(stream, frontierFirst, frontierLast);
+    int frontierStart = nodeCount - stream->ring[stream->lastDepth % GAME_MAP_WINDOW].nodeCount;
+
+    int node = 0;
+    for (int d = stream->firstDepth; d <= stream->lastDepth; d++)
+        for (int slot = 0; slot < stream->ring[d % GAME_MAP_WINDOW].nodeCount; slot++)
+            analysis->pathsFromRoot[node++] = stream->ringPaths[d % GAME_MAP_WINDOW][slot];
+
+    for (int i = nodeCount - 1; i >= 0; i--)
+    {
+        unsigned long long reach = 1ull << i;
+        int parentCount = GetGameMapParentCount(map, i);
+        const int *parents = GetGameMapParents(map, i);
+
+        if (parentCount == 0)
+        {
+            // window 最深一層 (結局層或還沒產生下一層的邊界)
+            analysis->firstEnding[i] = frontierFirst[i - frontierStart];
+            analysis->lastEnding[i] = frontierLast[i - frontierStart];
+        }
+        else
+        {
+            int firstEnding = analysis->firstEnding[parents[0]];
+            int lastEnding = analysis->lastEnding[parents[0]];
+            for (int k = 0; k < parentCount; k++)
+            {
+                reach |= analysis->reachMask[parents[k]];
+                if (analysis->firstEnding[parents[k]] < firstEnding) firstEnding = analysis->firstEnding[parents[k]];
+                if (analysis->lastEnding[parents[k]] > lastEnding) lastEnding = analysis->lastEnding[parents[k]];
+            }
+            analysis->firstEnding[i] = firstEnding;
+            analysis->lastEnding[i] = lastEnding;
+        }
+        analysis->reachMask[i] = reach;
+    }
+}
+
+void InitGameMapStream(GameMapStream *stream, unsigned int seed, int totalLevels, int maxPathsPerNode)
+{
+    stream->seed = seed;
+    stream->totalLevels = (totalLevels < 2)? 2 : totalLevels;
+    stream->maxPathsPerNode = (maxPathsPerNode < 1)? 1 : (maxPathsPerNode > 3)? 3 : maxPathsPerNode;
+    stream->firstDepth = 0;
+    stream->lastDepth = -1;
+
+    // window 大小固定, 先保留好容量之後就不會再配置記憶體
+    stream->map.level.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH);
+    stream->map.edgeOffset.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH + 1);
+    stream->map.edges.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_EDGES);
+    stream->map.labelOffset.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH);
+    stream->map.labelPool.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH*16);
+    stream->analysis.pathsFromRoot.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH);
+    stream->analysis.firstEnding.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH);
+    stream->analysis.lastEnding.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH);
+    stream->analysis.reachMask.reserve(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH);
+
+    BuildEndingRanges(stream);
+    AdvanceGameMapStream(stream, 0);
+}
+
+int AdvanceGameMapStream(GameMapStream *stream, int depth)
+{
+    int first = depth - GAME_MAP_KEEP_BEHIND;
+    int last = depth + GAME_MAP_LOOKAHEAD;
+    if (first < stream->firstDepth) first = stream->firstDepth;     // 只往前走
+    if (last > stream->totalLevels - 1) last = stream->totalLevels - 1;
+    if ((first == stream->firstDepth) && (last == stream->lastDepth)) return 0;
+
+    // 先算被移出的 node 數, 之後 ring slot 會被新層覆蓋
+    int evicted = 0;
+    for (int d = stream->firstDepth; d < first; d++) evicted += stream->ring[d % GAME_MAP_WINDOW].nodeCount;
+
+    for (int d = stream->lastDepth + 1; d <= last; d++)
+    {
+        GenerateGameMapLevel(stream->seed, d, stream->totalLevels, stream->maxPathsPerNode, &stream->ring[d % GAME_MAP_WINDOW]);
+        AccumulateLevelPaths(stream, d);
+    }
+
+    stream->firstDepth = first;
+    stream->lastDepth = last;
+    BuildStreamWindow(stream);
+    AnalyzeStreamWindow(stream);
+
+    return evicted;
+}
+
+GameMapStream *CreateGameMapStream(std::pmr::memory_resource *memory)
+{
+    void *p = memory->allocate(sizeof(GameMapStream), alignof(GameMapStream));
+    return new (p) GameMapStream{ 0, 0, 0, 0, 0, {}, {},
+        GameMap{ std::pmr::vector<int>(memory), std::pmr::vector<int>(memory), std::pmr::vector<int>(memory), std::pmr::vector<int>(memory), std::pmr::vector<char>(memory) },
+        GameMapAnalysis{ std::pmr::vector<unsigned long long>(memory), std::pmr::vector<int>(memory), std::pmr::vector<int>(memory), std::pmr::vector<unsigned long long>(memory) },
+        std::pmr::vector<unsigned char>(memory) };
+}
+
+size_t GetGameMapMemoryUsage(const GameMap *map)
+{
+    return sizeof(GameMap) +
+        map->level.capacity()*sizeof(int) +
+        map->edgeOffset.capacity()*sizeof(int) +
+        map->edges.capacity()*sizeof(int) +
+        map->labelOffset.capacity()*sizeof(int) +
+        map->labelPool.capacity();
+}
+
+std::vector<unsigned char> SaveGameMapBlob(const GameMap *map)
+{
+    GameMapBlobHeader header = {};
+    header.magic = GAME_MAP_BLOB_MAGIC;
+    header.version = GAME_MAP_BLOB_VERSION;
+    header.nodeCount = (uint32_t)map->level.size();
+    header.edgeCount = (uint32_t)map->edges.size();
+    header.poolSize = (uint32_t)map->labelPool.size();
+
+    size_t intCount = header.nodeCount*3 + 1 + header.edgeCount;
+    std::vector<unsigned char> blob(sizeof(header) + intCount*sizeof(int32_t) + header.poolSize);
+
+    unsigned char *ptr = blob.data();
+    auto Write = [&ptr](const void *src, size_t bytes) { if (bytes > 0) memcpy(ptr, src, bytes); ptr += bytes; };
+    Write(&header, sizeof(header));
+    Write(map->level.data(), map->level.size()*sizeof(int32_t));
+    Write(map->edgeOffset.data(), map->edgeOffset.size()*sizeof(int32_t));
+    Write(map->edges.data(), map->edges.size()*sizeof(int32_t));
+    Write(map->labelOffset.data(), map->labelOffset.size()*sizeof(int32_t));
+    Write(map->labelPool.data(), map->labelPool.size());
+
+    return blob;
+}
+
+bool LoadGameMapBlob(GameMap *map, const unsigned char *data, size_t size)
+{
+    GameMapBlobHeader header = {};
+    if ((data == NULL) || (size < sizeof(header))) return false;
+    memcpy(&header, data, sizeof(header));
+    if ((header.magic != GAME_MAP_BLOB_MAGIC) || (header.version != GAME_MAP_BLOB_VERSION)) return false;
+
+    size_t n = header.nodeCount;
+    size_t e = header.edgeCount;
+    if (size != sizeof(header) + (n*3 + 1 + e)*sizeof(int32_t) + header.poolSize) return false;
+
+    GameMap loaded;
+    const unsigned char *ptr = data + sizeof(header);
+    auto Read = [&ptr](std::pmr::vector<int> &dst, size_t count) { dst.resize(count); if (count > 0) memcpy(dst.data(), ptr, count*sizeof(int32_t)); ptr += count*sizeof(int32_t); };
+    Read(loaded.level, n);
+    Read(loaded.edgeOffset, n + 1);
+    Read(loaded.edges, e);
+    Read(loaded.labelOffset, n);
+    loaded.labelPool.assign(ptr, ptr + header.poolSize);
+
+    // 驗證: offsets 單調遞增, index 與 level 不越界, parent 一定在較低的 level (保證無環), 文字都有 '\0' 結尾
+    // level 不可為負; n 個節點最多佔 n 層, 跨度超過 n 會讓 layout 依 (maxLevel - minLevel) 配置的列數失控
+    if ((loaded.edgeOffset[0] != 0) || (loaded.edgeOffset[n] != (int)e)) return false;
+    int minLevel = INT_MAX, maxLevel = -1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (loaded.level[i] < 0) return false;
+        if (loaded.level[i] < minLevel) minLevel = loaded.level[i];
+        if (loaded.level[i] > maxLevel) maxLevel = loaded.level[i];
+    }
+    if ((n > 0) && (maxLevel - minLevel >= (int)n)) return false;
+    for (size_t i = 0; i < n; i++) if (loaded.edgeOffset[i] > loaded.edgeOffset[i + 1]) return false;
+    for (size_t i = 0; i < e; i++) if ((loaded.edges[i] < 0) || (loaded.edges[i] >= (int)n)) return false;
+    for (size_t i = 0; i < n; i++)
+        for (int k = loaded.edgeOffset[i]; k < loaded.edgeOffset[i + 1]; k++)
+            if (loaded.level[loaded.edges[k]] >= loaded.level[i]) return false;
+    if ((header.poolSize > 0) && (loaded.labelPool[header.poolSize - 1] != '\0')) return false;
+    for (size_t i = 0; i < n; i++) if ((loaded.labelOffset[i] < 0) || (loaded.labelOffset[i] >= (int)header.poolSize)) return false;
+
+    *map = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,101 @@
+﻿/**********************************************************************************************
+*   Game Map DAG (compressed-sparse-row storage)
+*
+*   每個 node 的 parents 連續存放在 edges 中, edgeOffset[i]..edgeOffset[i + 1] 即為 node i 的範圍
+*   文字統一 intern 到 labelPool, 整張地圖可存成一塊連續 binary blob
+*
+*   長途旅程的地圖以 GameMapStream 串流產生: 每層只由 (seed, depth) 決定,
+*   只保留 currentNode 前後幾層, 記憶體與產生時間和旅程長度無關
+*
+*   GameMapAnalysis 為 DAG 上的 dynamic programming 結果: root 往下的路徑數隨新層產生逐層累加,
+*   往終點方向的值只在 window 內做一次反向掃描, 皆為線性時間
+*   每條邊都剛好往下一層, 剩餘步數恆等於 level, 不需要 DP
+*   可到達的結局: 每層的邊依比例切分, 一段連續 slot 往下走仍是一段連續 slot, 所以只要記 [first, last];
+*   範圍只能從結局往回算, 所以 InitGameMapStream 從結局層往 root 掃一次 (每層重產生一次, O(總層數)),
+*   把每層每個 slot 的範圍存進 endingRanges (每個 slot 1 byte, 整段旅程唯一和長度成正比的資料);
+*   之後推進 window 只查表, 離結局很遠時也能知道走得到哪些結局. 可到達節點的 reachMask 則只涵蓋 window 內
+**********************************************************************************************/
+
+#pragma once
+#include <vector>
+#include <memory_resource>
+#include <stddef.h>
+
+//---------------------------------------------------------------------------
+// Streaming limits
+//---------------------------------------------------------------------------
+#define GAME_MAP_MAX_WIDTH      6       // 每層最多節點數
+#define GAME_MAP_MAX_EDGES      (GAME_MAP_MAX_WIDTH*3)  // 每層往下一層的邊數上限
+#define GAME_MAP_KEEP_BEHIND    1       // currentNode 之前保留的層數
+#define GAME_MAP_LOOKAHEAD      3       // currentNode 之後預先產生的層數
+#define GAME_MAP_WINDOW         (GAME_MAP_KEEP_BEHIND + 1 + GAME_MAP_LOOKAHEAD)
+#define GAME_MAP_MAX_REJECTS    4       // 單層被判定退化時最多重抽幾次
+
+static_assert(GAME_MAP_WINDOW*GAME_MAP_MAX_WIDTH <= 64, "window nodes must fit in a 64-bit reach mask");
+
+typedef struct GameMap {
+    std::pmr::vector<int> level;         // 每個 node 的層數 (上層越大)
+    std::pmr::vector<int> edgeOffset;    // CSR row pointer, size = nodeCount + 1
+    std::pmr::vector<int> edges;         // 所有 node 的 parents (往上連的節點 index)
+    std::pmr::vector<int> labelOffset;   // 每個 node 文字在 labelPool 的起點
+    std::pmr::vector<char> labelPool;    // interned labels, 以 '\0' 分隔
+} GameMap;
+
+// 單層資料, 只由 (seed, depth) 決定; edges 為下一層 (depth + 1) 的 slot
+typedef struct GameMapLevel {
+    int depth;                                  // 從 root 起算第幾層 (0 = root)
+    int nodeCount;
+    int edgeOffset[GAME_MAP_MAX_WIDTH + 1];
+    int edges[GAME_MAP_MAX_EDGES];
+} GameMapLevel;
+
+// DAG analysis, 與 map 的 local node index 對齊
+typedef struct GameMapAnalysis {
+    std::pmr::vector<unsigned long long> pathsFromRoot;  // root 到此節點的路徑數 (超過上限時飽和)
+    std::pmr::vector<int> firstEnding;                   // 可到達結局的 slot 範圍 (整段旅程, 不限 window)
+    std::pmr::vector<int> lastEnding;
+    std::pmr::vector<unsigned long long> reachMask;      // window 內可到達的節點 (bit = local index, 含自己)
+} GameMapAnalysis;
+
+// 串流地圖: ring 中保存 window 內的層, map 為 window 的 CSR 展開 (node index 為 window 內 local index)
+typedef struct GameMapStream {
+    unsigned int seed;
+    int totalLevels;                            // 整段旅程層數, 最後一層為結局
+    int maxPathsPerNode;
+    int firstDepth;                             // window 內最上 (最早) 一層
+    int lastDepth;                              // window 內最深一層
+    GameMapLevel ring[GAME_MAP_WINDOW];         // 以 depth % GAME_MAP_WINDOW 索引
+    unsigned long long ringPaths[GAME_MAP_WINDOW][GAME_MAP_MAX_WIDTH];  // 每層 root 路徑數, 產生新層時由上一層累加
+    GameMap map;
+    GameMapAnalysis analysis;
+    std::pmr::vector<unsigned char> endingRanges;   // [depth*GAME_MAP_MAX_WIDTH + slot] 可到達結局: 低 4 bits first, 高 4 bits last
+} GameMapStream;
+
+void GenerateGameMapLevel(unsigned int seed, int depth, int totalLevels, int maxPathsPerNode, GameMapLevel *out);
+GameMapStream *CreateGameMapStream(std::pmr::memory_resource *memory);             // 所有 container 都從 memory 配置, 隨 memory 一起釋放 (不用解構)
+void InitGameMapStream(GameMapStream *stream, unsigned int seed, int totalLevels, int maxPathsPerNode);
+int AdvanceGameMapStream(GameMapStream *stream, int depth);                        // 回傳被移出 window 的 node 數 (local index 位移量)
+inline int GetGameMapStreamDepth(const GameMapStream *stream, int node) { return stream->totalLevels - 1 - stream->map.level[node]; }
+// node 是所在層的第幾個 (與 window 位置無關, 和 depth 一起可以當節點的固定 id)
+inline int GetGameMapStreamSlot(const GameMapStream *stream, int node)
+{
+    int first = 0;
+    for (int d = stream->firstDepth; d < GetGameMapStreamDepth(stream, node); d++) first += stream->ring[d % GAME_MAP_WINDOW].nodeCount;
+    return node - first;
+}
+// 可到達的結局 (bit = 結局 slot)
+inline unsigned int GetGameMapReachableEndings(const GameMapStream *stream, int node)
+{
+    return (2u << stream->analysis.lastEnding[node]) - (1u << stream->analysis.firstEnding[node]);
+}
+inline char GetGameMapEndingLetter(int slot) { return (char)('A' + slot); }
+
+inline int GetGameMapNodeCount(const GameMap *map) { return (int)map->level.size(); }
+inline int GetGameMapEdgeCount(const GameMap *map) { return (int)map->edges.size(); }
+inline int GetGameMapParentCount(const GameMap *map, int node) { return map->edgeOffset[node + 1] - map->edgeOffset[node]; }
+inline const int *GetGameMapParents(const GameMap *map, int node) { return map->edges.data() + map->edgeOffset[node]; }
+inline const char *GetGameMapLabel(const GameMap *map, int node) { return map->labelPool.data() + map->labelOffset[node]; }
+
+size_t GetGameMapMemoryUsage(const GameMap *map);                                   // 實際佔用 bytes (含 container 本體)
+std::vector<unsigned char> SaveGameMapBlob(const GameMap *map);                     // 序列化成 flat binary blob
+bool LoadGameMapBlob(GameMap *map, const unsigned char *data, size_t size);         // 驗證後載入, 失敗回傳 false
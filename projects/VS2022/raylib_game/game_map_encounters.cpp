@@ -0,0 +1,189 @@
+﻿/**********************************************************************************************
+*   Game map encounter prefetch
+**********************************************************************************************/
+
+#include "game_map_encounters.h"
+#include "battle_zobrist.h"
+
+unsigned int GetEncounterSeed(unsigned int mapSeed, unsigned int key)
+{
+    return (unsigned int)MixZobristKey(((uint64_t)mapSeed << 32) | key);
+}
+
+// 以下都要在持有 mutex 時呼叫
+static EncounterCacheEntry *FindEncounterEntry(EncounterCache *cache, unsigned int key)
+{
+    for (int i = 0; i < ENCOUNTER_CACHE_SIZE; i++)
+        if (cache->entries[i].used && (cache->entries[i].key == key)) return &cache->entries[i];
+    return NULL;
+}
+
+static bool IsEncounterWanted(const EncounterCache *cache, unsigned int key)
+{
+    for (int i = 0; i < cache->wantedCount; i++)
+        if (cache->wanted[i] == key) return true;
+    return false;
+}
+
+// 第一個還沒模擬好的 wanted 節點
+static bool FindPendingEncounter(EncounterCache *cache, unsigned int *key)
+{
+    for (int i = 0; i < cache->wantedCount; i++)
+    {
+        if (FindEncounterEntry(cache, cache->wanted[i]) != NULL) continue;
+        *key = cache->wanted[i];
+        return true;
+    }
+    return false;
+}
+
+// 放進空位, 沒有空位就換掉最久沒用、且目前不需要的那個
+static void StoreEncounter(EncounterCache *cache, unsigned int key, const Encounter *encounter, const EncounterSummary *summary)
+{
+    EncounterCacheEntry *slot = NULL;
+    for (int i = 0; i < ENCOUNTER_CACHE_SIZE; i++)
+        if (!cache->entries[i].used) { slot = &cache->entries[i]; break; }
+    if (slot == NULL)
+    {
+        for (int i = 0; i < ENCOUNTER_CACHE_SIZE; i++)
+        {
+            EncounterCacheEntry *entry = &cache->entries[i];
+            if (IsEncounterWanted(cache, entry->key)) continue;
+            if ((slot == NULL) || (entry->lastUse < slot->lastUse)) slot = entry;
+        }
+    }
+    if (slot == NULL) return;       // 快取比 prefetch 的節點數還小時才會發生
+
+    slot->key = key;
+    slot->used = true;
+    slot->encounter = *encounter;
+    slot->summary = *summary;
+    slot->lastUse = ++cache->useClock;
+    cache->simulatedCount++;
+}
+
+#if defined(ENCOUNTER_CACHE_THREADED)
+static void RunEncounterWorker(EncounterCache *cache)
+{
+    Encounter encounter;
+    for (;;)
+    {
+        unsigned int key, generation;
+        {
+            std::unique_lock<std::mutex> lock(cache->mutex);
+            cache->wake.wait(lock, [&]() { return cache->quit || FindPendingEncounter(cache, &key); });
+            if (cache->quit) return;
+            generation = cache->generation.load();
+        }
+
+        GenerateEncounter(GetEncounterSeed(cache->mapSeed, key), &encounter);
+        EncounterSummary summary = {};
+        bool done = SimulateEncounter(&encounter, 0, ENCOUNTER_PRESIM_SEEDS, &summary, &cache->generation, generation);
+
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        if (done) StoreEncounter(cache, key, &encounter, &summary);
+        else cache->cancelledCount++;
+    }
+}
+#endif
+
+void StartEncounterCache(EncounterCache *cache, unsigned int mapSeed)
+{
+    cache->mapSeed = mapSeed;
+    cache->generation.store(0);
+    cache->wantedCount = 0;
+    for (int i = 0; i < ENCOUNTER_CACHE_SIZE; i++) cache->entries[i].used = false;
+    cache->useClock = 0;
+    cache->simulatedCount = 0;
+    cache->cancelledCount = 0;
+
+#if defined(ENCOUNTER_CACHE_THREADED)
+    cache->quit = false;
+    cache->worker = std::thread(RunEncounterWorker, cache);
+#else
+    cache->pending = false;
+#endif
+}
+
+void StopEncounterCache(EncounterCache *cache)
+{
+#if defined(ENCOUNTER_CACHE_THREADED)
+    if (!cache->worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        cache->quit = true;
+        cache->generation++;            // 讓還在模擬的那場馬上放棄
+    }
+    cache->wake.notify_one();
+    cache->worker.join();
+#else
+    cache->pending = false;
+#endif
+}
+
+void PrefetchEncounters(EncounterCache *cache, const unsigned int *keys, int count)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        cache->wantedCount = (count < ENCOUNTER_MAX_PREFETCH)? count : ENCOUNTER_MAX_PREFETCH;
+        for (int i = 0; i < cache->wantedCount; i++) cache->wanted[i] = keys[i];
+        cache->generation++;
+    }
+#if defined(ENCOUNTER_CACHE_THREADED)
+    cache->wake.notify_one();
+#else
+    if (cache->pending && !IsEncounterWanted(cache, cache->pendingKey))
+    {
+        cache->pending = false;
+        cache->cancelledCount++;
+    }
+#endif
+}
+
+void UpdateEncounterCache(EncounterCache *cache)
+{
+#if defined(ENCOUNTER_CACHE_THREADED)
+    (void)cache;                        // 背景 worker 自己會跑
+#else
+    if (!cache->pending)
+    {
+        if (!FindPendingEncounter(cache, &cache->pendingKey)) return;
+        GenerateEncounter(GetEncounterSeed(cache->mapSeed, cache->pendingKey), &cache->pendingEncounter);
+        cache->pendingSummary = EncounterSummary{};
+        cache->pending = true;
+    }
+
+    int first = cache->pendingSummary.runs;
+    int count = ENCOUNTER_PRESIM_SEEDS - first;
+    if (count > ENCOUNTER_FRAME_SEEDS) count = ENCOUNTER_FRAME_SEEDS;
+    SimulateEncounter(&cache->pendingEncounter, first, count, &cache->pendingSummary, NULL, 0);
+    if (cache->pendingSummary.runs < ENCOUNTER_PRESIM_SEEDS) return;
+
+    StoreEncounter(cache, cache->pendingKey, &cache->pendingEncounter, &cache->pendingSummary);
+    cache->pending = false;
+#endif
+}
+
+bool GetEncounterSummary(EncounterCache *cache, unsigned int key, EncounterSummary *out)
+{
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    EncounterCacheEntry *entry = FindEncounterEntry(cache, key);
+    if (entry == NULL) return false;
+    entry->lastUse = ++cache->useClock;
+    *out = entry->summary;
+    return true;
+}
+
+void GetNodeEncounter(EncounterCache *cache, unsigned int key, Encounter *out)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        EncounterCacheEntry *entry = FindEncounterEntry(cache, key);
+        if (entry != NULL)
+        {
+            *out = entry->encounter;
+            return;
+        }
+    }
+    GenerateEncounter(GetEncounterSeed(cache->mapSeed, key), out);
+}
@@ -0,0 +1,78 @@
+﻿/**********************************************************************************************
+*   Game map encounter prefetch
+*
+*   玩家在 GAME_MAP 選下一步時, 背景先把 currentNode 每個 parent 的戰鬥產生好並預先模擬
+*   (battle_encounter.h), 戰鬥本身與模擬結果依節點快取, 地圖可以馬上顯示難度,
+*   玩家選定節點時直接把快取裡的那場戰鬥交給 GAMEPLAY (HandOffEncounter)
+*
+*   節點以 (depth, slot) 當 key: 串流 window 推進後 local index 會變, (depth, slot) 不會;
+*   戰鬥 seed 由地圖 seed 與 key 混合而成, 同一張地圖的同一個節點永遠是同一場戰鬥
+*
+*   每次 PrefetchEncounters 都把 generation + 1, 還在模擬的舊節點 (玩家沒走的分支) 立刻放棄
+*   有執行緒時在背景 worker 上跑; PLATFORM_WEB 由 UpdateEncounterCache() 每幀跑幾場
+**********************************************************************************************/
+
+#pragma once
+#include "battle_encounter.h"
+#include "game_map.h"
+#include <mutex>
+
+#if !defined(PLATFORM_WEB)
+    #define ENCOUNTER_CACHE_THREADED
+    #include <condition_variable>
+    #include <thread>
+#endif
+
+#define ENCOUNTER_CACHE_SIZE        8
+#define ENCOUNTER_MAX_PREFETCH      GAME_MAP_MAX_WIDTH
+#define ENCOUNTER_FRAME_SEEDS       4           // 沒有執行緒時每幀模擬幾場
+
+typedef struct EncounterCacheEntry {
+    unsigned int key;
+    bool used;
+    Encounter encounter;
+    EncounterSummary summary;
+    unsigned int lastUse;                       // LRU
+} EncounterCacheEntry;
+
+typedef struct EncounterCache {
+    unsigned int mapSeed;
+
+    std::atomic<unsigned int> generation;       // 每次 prefetch + 1, 模擬中途會讀
+    std::mutex mutex;                           // 保護以下所有欄位
+    unsigned int wanted[ENCOUNTER_MAX_PREFETCH];
+    int wantedCount;
+    EncounterCacheEntry entries[ENCOUNTER_CACHE_SIZE];
+    unsigned int useClock;
+    int simulatedCount;                         // 完成 / 中途放棄的節點數 (統計用)
+    int cancelledCount;
+
+#if defined(ENCOUNTER_CACHE_THREADED)
+    std::condition_variable wake;
+    std::thread worker;
+    bool quit;
+#else
+    unsigned int pendingKey;                    // 正在分段模擬的節點
+    bool pending;
+    Encounter pendingEncounter;
+    EncounterSummary pendingSummary;
+#endif
+} EncounterCache;
+
+inline unsigned int GetEncounterNodeKey(int depth, int slot) { return (unsigned int)(depth*GAME_MAP_MAX_WIDTH + slot); }
+unsigned int GetEncounterSeed(unsigned int mapSeed, unsigned int key);
+
+void StartEncounterCache(EncounterCache *cache, unsigned int mapSeed);
+void StopEncounterCache(EncounterCache *cache);
+
+// 換成只準備 keys 這些節點: 其他還在算的放棄, 已完成的留在快取裡
+void PrefetchEncounters(EncounterCache *cache, const unsigned int *keys, int count);
+
+// 沒有執行緒時每幀呼叫一次; 有執行緒時什麼都不做
+void UpdateEncounterCache(EncounterCache *cache);
+
+// 節點已模擬完成時複製結果並回傳 true
+bool GetEncounterSummary(EncounterCache *cache, unsigned int key, EncounterSummary *out);
+
+// 節點的戰鬥: 快取裡有就複製 (與顯示的難度是同一場), 還沒模擬完就用同一個 seed 現場產生
+void GetNodeEncounter(EncounterCache *cache, unsigned int key, Encounter *out);
@@ -1,11 +1,18 @@
-#pragma once
-#include <string>
-#include <vector>
+﻿#pragma once
+#include <array>
+#include <string_view>
+#include "battle_fixed.h"
+
+// 兵種資料表: 全部 constexpr, 不會在每個 translation unit 產生動態初始化的副本
 namespace GameData{
+    enum UnitTypeIndex { UNIT_FOOTMAN = 0, UNIT_ARCHER, UNIT_KNIGHT, UNIT_SPEARMAN, UNIT_TYPE_COUNT };
+
+    constexpr int MAX_UNIT_LEVEL = 10;
+
     struct Unit {
         int id;
-        std::string name;
-        std::string desc;
+        std::string_view name;      // NOTE: 皆由字串常數建立, data() 可直接當 '\0' 結尾字串使用
+        std::string_view desc;
         float hp;
         float atk;
         float spd;
@@ -14,13 +21,41 @@ namespace GameData{
         float atk_lv;
         float spd_lv;
         float range_lv;
-        /* UNKNOWN_TYPE */;
     };
 
-    const std::vector<Unit> AllUnits = {
+    inline constexpr std::array<Unit, UNIT_TYPE_COUNT> AllUnits = {{
         Unit{1, "footman", "basic", 10.0f, 2.0f, 1.0f, 1.0f, 2.5f, 1.0f, 0.0f, 0.0f, },
         Unit{2, "archer", "range", 5.0f, 1.0f, 1.0f, 5.0f, 0.0f, 0.5f, 0.0f, 0.2f, },
         Unit{3, "knight", "move faster", 15.0f, 1.0f, 2.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, },
         Unit{4, "spearman", "counter kinght", 10.0f, 1.0f, 1.0f, 1.0f, 2.0f, 1.0f, 0.0f, 0.0f, }
-    };
+    }};
+
+    // 每級數值曲線: stat(level) = base + perLevel * (level - 1), level = 1 ~ MAX_UNIT_LEVEL
+    // base / perLevel 各自在編譯期轉成 Fixed 再用整數相乘相加, 每個平台得到一樣的數值
+    using StatCurve = std::array<Fixed, MAX_UNIT_LEVEL>;
+    using StatTable = std::array<StatCurve, UNIT_TYPE_COUNT>;
+
+    template <float Unit::*Base, float Unit::*PerLevel>
+    constexpr StatTable MakeStatTable()
+    {
+        StatTable table = {};
+        for (int u = 0; u < UNIT_TYPE_COUNT; u++)
+            for (int lv = 0; lv < MAX_UNIT_LEVEL; lv++)
+                table[u][lv] = FloatToFixed(AllUnits[u].*Base) + FloatToFixed(AllUnits[u].*PerLevel)*lv;
+        return table;
+    }
+
+    inline constexpr StatTable HpTable = MakeStatTable<&Unit::hp, &Unit::hp_lv>();
+    inline constexpr StatTable AtkTable = MakeStatTable<&Unit::atk, &Unit::atk_lv>();
+    inline constexpr StatTable SpdTable = MakeStatTable<&Unit::spd, &Unit::spd_lv>();
+    inline constexpr StatTable RangeTable = MakeStatTable<&Unit::range, &Unit::range_lv>();
+
+    constexpr Fixed GetUnitHp(int type, int level) { return HpTable[type][level - 1]; }
+    constexpr Fixed GetUnitAtk(int type, int level) { return AtkTable[type][level - 1]; }
+    constexpr Fixed GetUnitSpd(int type, int level) { return SpdTable[type][level - 1]; }
+    constexpr Fixed GetUnitRange(int type, int level) { return RangeTable[type][level - 1]; }
+
+    static_assert(AllUnits[UNIT_ARCHER].range == 5.0f, "catalog index must match UnitTypeIndex");
+    static_assert(GetUnitHp(UNIT_FOOTMAN, 3) == IntToFixed(15), "stat curves are evaluated at compile time");
+    static_assert(FixedRoundToInt(GetUnitRange(UNIT_ARCHER, 6)) == 6, "fractional per-level stats accumulate in fixed point");
 }
\ No newline at end of file
@@ -0,0 +1,160 @@
+﻿/**********************************************************************************************
+*   Heap allocation instrumentation (opt-in)
+**********************************************************************************************/
+
+#include "memory_stats.h"
+
+#if defined(MEMORY_STATS)
+#include "raylib.h"
+#include "screens.h"
+#include "screen_arena.h"
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+// 每塊配置前面的 header, 記錄大小讓 delete 可以扣掉存活量; 大小維持 malloc 的對齊
+#define MEMORY_HEADER_SIZE  16
+
+typedef struct ScreenMemoryStats {
+    std::atomic<unsigned long long> allocations[MEMORY_PHASE_COUNT];
+    std::atomic<unsigned long long> bytes[MEMORY_PHASE_COUNT];
+    std::atomic<size_t> peakLive;               // 在這個 screen 時 heap 存活量的最高值
+    unsigned long long frames;
+    unsigned long long maxFrameAllocations;
+} ScreenMemoryStats;
+
+static std::atomic<unsigned long long> allocationCount(0);
+static std::atomic<size_t> liveBytes(0);
+static std::atomic<size_t> peakBytes(0);
+
+static std::atomic<int> scopeScreen(LOGO);
+static std::atomic<int> scopePhase(MEMORY_PHASE_TRANSITION);
+
+static ScreenMemoryStats screenStats[SCREEN_COUNT];
+static std::atomic<unsigned long long> frameAllocations[MEMORY_PHASE_COUNT];
+static std::atomic<unsigned long long> frameBytes[MEMORY_PHASE_COUNT];
+static MemoryCounters lastFrame[MEMORY_PHASE_COUNT];
+
+static const char *phaseNames[MEMORY_PHASE_COUNT] = { "update", "draw", "transition" };
+
+static void RaiseToAtLeast(std::atomic<size_t> &value, size_t candidate)
+{
+    size_t current = value.load(std::memory_order_relaxed);
+    while ((candidate > current) && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) { }
+}
+
+//---------------------------------------------------------------------------
+// Global operator new / delete
+//---------------------------------------------------------------------------
+void *operator new(size_t size)
+{
+    unsigned char *block = (unsigned char *)malloc(size + MEMORY_HEADER_SIZE);
+    if (block == NULL) throw std::bad_alloc();
+    *(size_t *)block = size;
+
+    int screen = scopeScreen.load(std::memory_order_relaxed);
+    int phase = scopePhase.load(std::memory_order_relaxed);
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    frameAllocations[phase].fetch_add(1, std::memory_order_relaxed);
+    frameBytes[phase].fetch_add(size, std::memory_order_relaxed);
+    screenStats[screen].allocations[phase].fetch_add(1, std::memory_order_relaxed);
+    screenStats[screen].bytes[phase].fetch_add(size, std::memory_order_relaxed);
+
+    size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    RaiseToAtLeast(peakBytes, live);
+    RaiseToAtLeast(screenStats[screen].peakLive, live);
+
+    return block + MEMORY_HEADER_SIZE;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept
+{
+    if (p == NULL) return;
+    unsigned char *block = (unsigned char *)p - MEMORY_HEADER_SIZE;
+    liveBytes.fetch_sub(*(size_t *)block, std::memory_order_relaxed);
+    free(block);
+}
+
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+//---------------------------------------------------------------------------
+// Queries
+//---------------------------------------------------------------------------
+unsigned long long GetAllocationCount(void) { return allocationCount.load(std::memory_order_relaxed); }
+size_t GetLiveHeapBytes(void) { return liveBytes.load(std::memory_order_relaxed); }
+size_t GetPeakHeapBytes(void) { return peakBytes.load(std::memory_order_relaxed); }
+
+void SetMemoryStatsScope(int screen, MemoryPhase phase)
+{
+    scopeScreen.store(screen, std::memory_order_relaxed);
+    scopePhase.store(phase, std::memory_order_relaxed);
+    RaiseToAtLeast(screenStats[screen].peakLive, GetLiveHeapBytes());
+}
+
+// frame 數與單一 frame 最多配置次數 (不含切換 screen) 記在 frame 結束時的 screen
+void EndMemoryStatsFrame(void)
+{
+    unsigned long long total = 0;
+    for (int p = 0; p < MEMORY_PHASE_COUNT; p++)
+    {
+        lastFrame[p].allocations = frameAllocations[p].exchange(0, std::memory_order_relaxed);
+        lastFrame[p].bytes = frameBytes[p].exchange(0, std::memory_order_relaxed);
+        if (p != MEMORY_PHASE_TRANSITION) total += lastFrame[p].allocations;
+    }
+
+    ScreenMemoryStats *stats = &screenStats[scopeScreen.load(std::memory_order_relaxed)];
+    stats->frames++;
+    if (total > stats->maxFrameAllocations) stats->maxFrameAllocations = total;
+}
+
+MemoryCounters GetFrameMemoryCounters(MemoryPhase phase) { return lastFrame[phase]; }
+
+//---------------------------------------------------------------------------
+// Output
+//---------------------------------------------------------------------------
+void DrawMemoryStatsOverlay(int x, int y)
+{
+    int screen = scopeScreen.load(std::memory_order_relaxed);
+    const ScreenArena *arena = GetScreenArena(screen);
+
+    DrawRectangle(x - 4, y - 4, 330, 4*18 + 8, Fade(BLACK, 0.6f));
+    DrawText(TextFormat("heap: live %.1f KB, peak %.1f KB", GetLiveHeapBytes()/1024.0f, GetPeakHeapBytes()/1024.0f), x, y, 16, LIME);
+    for (int p = 0; p < MEMORY_PHASE_COUNT; p++)
+        DrawText(TextFormat("%s: %llu allocs, %llu B", phaseNames[p], lastFrame[p].allocations, lastFrame[p].bytes), x, y + 18*(p + 1), 16, LIME);
+    DrawText(TextFormat("%s arena: %.1f / %.1f KB", GetScreenName(screen), arena->GetUsed()/1024.0f, arena->GetCapacity()/1024.0f), x, y + 18*4, 16, LIME);
+}
+
+// 每個 screen 一列: 各階段累計的次數 / bytes, 平均與最多每 frame 配置次數, heap 與 arena 的最高用量
+bool WriteMemoryStatsCsv(const char *fileName)
+{
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "screen,frames");
+    for (int p = 0; p < MEMORY_PHASE_COUNT; p++) fprintf(file, ",%s_allocs,%s_bytes", phaseNames[p], phaseNames[p]);
+    fprintf(file, ",allocs_per_frame,max_frame_allocs,peak_live_bytes,arena_peak_bytes\n");
+
+    for (int s = 0; s < SCREEN_COUNT; s++)
+    {
+        const ScreenMemoryStats *stats = &screenStats[s];
+        unsigned long long total = 0;
+        fprintf(file, "%s,%llu", GetScreenName(s), stats->frames);
+        for (int p = 0; p < MEMORY_PHASE_COUNT; p++)
+        {
+            unsigned long long allocations = stats->allocations[p].load(std::memory_order_relaxed);
+            fprintf(file, ",%llu,%llu", allocations, stats->bytes[p].load(std::memory_order_relaxed));
+            if (p != MEMORY_PHASE_TRANSITION) total += allocations;
+        }
+        fprintf(file, ",%.2f,%llu,%zu,%zu\n", (stats->frames > 0)? (double)total/stats->frames : 0.0, stats->maxFrameAllocations,
+            stats->peakLive.load(std::memory_order_relaxed), GetScreenArena(s)->GetLifetimePeak());
+    }
+
+    fclose(file);
+    return true;
+}
+#endif
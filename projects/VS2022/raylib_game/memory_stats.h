@@ -0,0 +1,44 @@
+﻿/**********************************************************************************************
+*   Heap allocation instrumentation (opt-in)
+*
+*   定義 MEMORY_STATS 時取代全域 operator new / delete:
+*       每次配置記在「目前的 screen + frame 階段」(Update / Draw / 切換 screen) 底下,
+*       記錄次數、bytes, 以及 heap 上目前 / 最高的存活量 (每塊前面多放一個 header 記大小)
+*   主迴圈以 SetMemoryStatsScope 標示目前階段, 每個 frame 結束呼叫 EndMemoryStatsFrame;
+*   DrawMemoryStatsOverlay 顯示上一個 frame 的數字, 結束時 WriteMemoryStatsCsv 輸出各 screen 的統計
+*
+*   BATTLE_BENCHMARK 會自動打開, 讓 benchmark 可以檢查某段程式有沒有配置記憶體
+*   沒定義時這個模組完全不存在, 不影響一般 build
+**********************************************************************************************/
+
+#pragma once
+#include <stddef.h>
+
+#if defined(BATTLE_BENCHMARK) && !defined(MEMORY_STATS)
+    #define MEMORY_STATS
+#endif
+
+#if defined(MEMORY_STATS)
+typedef enum {
+    MEMORY_PHASE_UPDATE = 0,
+    MEMORY_PHASE_DRAW,
+    MEMORY_PHASE_TRANSITION,        // screen 的 Unload / Init
+    MEMORY_PHASE_COUNT
+} MemoryPhase;
+
+typedef struct MemoryCounters {
+    unsigned long long allocations;
+    unsigned long long bytes;
+} MemoryCounters;
+
+unsigned long long GetAllocationCount(void);    // 程式開始到現在的 operator new 次數
+size_t GetLiveHeapBytes(void);
+size_t GetPeakHeapBytes(void);
+
+void SetMemoryStatsScope(int screen, MemoryPhase phase);        // screen: GameScreen
+void EndMemoryStatsFrame(void);
+MemoryCounters GetFrameMemoryCounters(MemoryPhase phase);       // 上一個完整 frame 的數字
+
+void DrawMemoryStatsOverlay(int x, int y);
+bool WriteMemoryStatsCsv(const char *fileName);
+#endif
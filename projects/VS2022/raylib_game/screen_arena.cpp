@@ -0,0 +1,97 @@
+﻿/**********************************************************************************************
+*   Screen-scoped memory arenas
+**********************************************************************************************/
+
+#include "raylib.h"
+#include "screens.h"
+#include "screen_arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+static ScreenArena screenArenas[SCREEN_COUNT];
+static ScreenArena frameArena;
+
+static const char *screenNames[SCREEN_COUNT] = { "LOGO", "TITLE", "OPTIONS", "SETUP", "GAME_MAP", "GAMEPLAY", "GAME_REWARD", "ENDING" };
+
+ScreenArena::~ScreenArena()
+{
+    FreeBlocks();
+}
+
+void ScreenArena::FreeBlocks()
+{
+    while (blocks != nullptr)
+    {
+        Block *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    cursor = nullptr;
+    end = nullptr;
+    capacity = 0;
+}
+
+void ScreenArena::AddBlock(size_t size)
+{
+    Block *block = (Block *)malloc(size);
+    if (block == nullptr) throw std::bad_alloc();
+
+    block->next = blocks;
+    block->size = size;
+    blocks = block;
+    cursor = (char *)(block + 1);
+    end = (char *)block + size;
+    capacity += size - sizeof(Block);
+}
+
+void *ScreenArena::do_allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t p = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if ((cursor == nullptr) || (p + bytes > (uintptr_t)end))
+    {
+        // 放不下: 串上一塊至少是目前總容量兩倍的新記憶體
+        size_t size = (capacity > 0)? capacity*2 : SCREEN_ARENA_BLOCK_SIZE;
+        if (size < bytes + alignment + sizeof(Block)) size = bytes + alignment + sizeof(Block);
+        AddBlock(size);
+        p = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    used += (p + bytes) - (uintptr_t)cursor;
+    cursor = (char *)(p + bytes);
+    if (used > peak) peak = used;
+    if (used > lifetimePeak) lifetimePeak = used;
+    return (void *)p;
+}
+
+void ScreenArena::Release()
+{
+    // 只有一塊 (一般情況) 時只是把游標移回開頭; 多塊時合併成一塊, 下次就放得下
+    if ((blocks != nullptr) && (blocks->next != nullptr))
+    {
+        size_t total = capacity + sizeof(Block);
+        FreeBlocks();
+        AddBlock(total);
+    }
+    else if (blocks != nullptr) cursor = (char *)(blocks + 1);
+
+    used = 0;
+    peak = 0;
+}
+
+ScreenArena *GetScreenArena(int screen) { return &screenArenas[screen]; }
+ScreenArena *GetFrameArena(void) { return &frameArena; }
+const char *GetScreenName(int screen) { return screenNames[screen]; }
+
+void ReleaseScreenArena(int screen)
+{
+    ScreenArena *arena = &screenArenas[screen];
+    TraceLog(LOG_INFO, "ARENA: %s released, peak %zu bytes (lifetime peak %zu, capacity %zu), frame arena peak %zu bytes",
+        GetScreenName(screen), arena->GetPeak(), arena->GetLifetimePeak(), arena->GetCapacity(), frameArena.GetLifetimePeak());
+    arena->Release();
+}
+
+void ResetFrameArena(void)
+{
+    frameArena.Release();
+}
@@ -0,0 +1,65 @@
+﻿/**********************************************************************************************
+*   Screen-scoped memory arenas
+*
+*   每個 screen 一個 monotonic arena (ScreenArena, 可當 std::pmr::memory_resource 使用):
+*   screen 的 container 以 std::pmr 從自己的 arena 配置, 個別 deallocate 不做任何事;
+*   離開 screen (Unload 之後) 整個 arena 一次歸零, 不用逐一解構或 free
+*   另有一個 frame arena 給單一 frame 內的暫存, 每次 EndDrawing 之後歸零
+*
+*   arena 保留第一塊記憶體重複使用; 某次用量超過容量時串上新的一塊,
+*   Release 時再合併成一塊夠大的, 之後的造訪就不會再向系統要記憶體
+*
+*   目前只有 GAME_MAP (地圖與 layout) 從 arena 配置; SETUP / GAMEPLAY 的尋路、視野等暫存在 Init 時
+*   用 std::vector 配置好, 之後的造訪沿用同樣的容量, 戰鬥中本來就不配置記憶體, 不需要 arena
+*   其他 screen 的 arena 一直是空的, 每次離開時照樣 Release (只回報用量)
+**********************************************************************************************/
+
+#pragma once
+#include <memory_resource>
+#include <stddef.h>
+
+#define SCREEN_ARENA_BLOCK_SIZE     (64*1024)   // 第一次配置的大小
+
+class ScreenArena : public std::pmr::memory_resource
+{
+public:
+    ScreenArena() = default;
+    ScreenArena(const ScreenArena &) = delete;
+    ScreenArena &operator=(const ScreenArena &) = delete;
+    ~ScreenArena() override;
+
+    void Release();                     // 所有配置一次失效, 游標回到開頭
+    size_t GetUsed() const { return used; }
+    size_t GetPeak() const { return peak; }             // 目前這次造訪 (上次 Release 之後) 的最高用量
+    size_t GetLifetimePeak() const { return lifetimePeak; }
+    size_t GetCapacity() const { return capacity; }
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override { }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+    struct Block {
+        Block *next;                    // 較早配置的一塊
+        size_t size;                    // 含 Block header
+    };
+
+    void AddBlock(size_t size);
+    void FreeBlocks();
+
+    Block *blocks = nullptr;            // 目前使用中的一塊 (串列開頭)
+    char *cursor = nullptr;
+    char *end = nullptr;
+    size_t used = 0;
+    size_t peak = 0;
+    size_t lifetimePeak = 0;
+    size_t capacity = 0;
+};
+
+ScreenArena *GetScreenArena(int screen);    // screen: GameScreen
+ScreenArena *GetFrameArena(void);
+const char *GetScreenName(int screen);
+
+void ReleaseScreenArena(int screen);        // 在 UnloadXScreen 之後呼叫, 並回報該 screen 的最高用量
+void ResetFrameArena(void);                 // 每個 frame EndDrawing 之後呼叫
@@ -4,122 +4,296 @@
 
 #include "raylib.h"
 #include "screens.h"
+#include "game_map.h"
+#include "screen_arena.h"
+#include "game_map_encounters.h"
 #include <vector>
 #include <string>
 #include <algorithm>
 #include <iostream>
 #include <queue>
+#include <math.h>
+#include <string.h>
+#include <new>
 
 //---------------------------------------------------------------------------
-// Tree data structure
+// Tree data structure (streamed CSR window, see game_map.h)
 //---------------------------------------------------------------------------
-typedef struct GameMapNode {
-    std::string text;
-    std::vector<int> parents;   // 往上連的節點 index
-    int level; // 上層越大
-    //GameMapNode(const char* t, std::vector<int> p, int l)
-    //    : text(t), parents(std::move(p)), level(l) {}
-    //GameMapNode() : text(), parents(), level() {}
-} GameMapNode;
-
-// 模擬一棵決策樹 (可自由改)
-std::vector<GameMapNode> game_map_tree = {
-    {"Ending A", {}, 0},             // 0: Leaf
-    {"Ending B", {}, 0},             // 1: Leaf
-    {"Ending C", {}, 0},             // 2: Leaf
-    {"Ending D", {}, 0},             // 3
-    {"Ending E", {}, 0},             // 4
-
-    {"Path AB", {0,1}, 1},           // 5
-    {"Path BC", {1,2}, 1},           // 6
-
-    {"Root Start", {6, 7}, 2}         // 7 Top
-};
-
-static std::vector<Vector2> nodePos; // 暫存每個 node 的畫面座標
+static GameMapStream *mapStream = NULL;     // 從 GAME_MAP screen arena 配置
+static const GameMap *gameMap = NULL;
+static const int runLevels = 200;   // 一趟旅程的層數
+
 static int RADIOUS = 32;
+static const float LAYOUT_OFFSET_X = 120.0f;    // 同層節點間距 (world)
+static const float LAYOUT_OFFSET_Y = 100.0f;    // 層與層間距 (world)
+static const float PICK_CELL_SIZE = 128.0f;     // 空間索引格子大小, 需 >= 2 * RADIOUS
+
+//---------------------------------------------------------------------------
+// Layout cache (window 變動時由 BuildGameMapLayout 重算, Draw 只讀)
+// NOTE: 座標為 world space, y = -depth * LAYOUT_OFFSET_Y, 串流推進時舊節點座標不會跳動
+// 所有 container 都從 GAME_MAP screen arena 配置, 離開 screen 時整塊釋放
+//---------------------------------------------------------------------------
+typedef struct GameMapLayout {
+    std::pmr::vector<Vector2> nodePos;          // 每個 node 的 world 座標
+    std::pmr::vector<int> labelWidth;           // 每個 node 文字寬度 (MeasureText 快取)
+    std::pmr::vector<int> levelStart;           // levelNodes 中每一列的起點, size = rows + 1
+    std::pmr::vector<int> levelFill;            // counting sort 暫存
+    std::pmr::vector<int> levelNodes;           // 依列排好的 node index (flat)
+    std::pmr::vector<Vector2> edgeFrom;         // 已解析的邊端點 (node -> parent)
+    std::pmr::vector<Vector2> edgeTo;
+    std::pmr::vector<unsigned char> clickable;  // currentNode 的 parents 標記
+
+    // Uniform grid spatial index (滑鼠點選用)
+    std::pmr::vector<int> cellStart;            // 每格在 cellNodes 的起點, size = cols * rows + 1
+    std::pmr::vector<int> cellNodes;
+    std::pmr::vector<int> cellFill;
+} GameMapLayout;
+
+static GameMapLayout *layout = NULL;
+static int layoutRows = 0;
+static float layoutTopY = 0.0f;             // 第 0 列 (最深一層) 的 y
+static Vector2 gridOrigin = {};
+static int gridCols = 0;
+static int gridRows = 0;
+
+// arena 上建立空的 layout; 不用解構, 隨 arena 一起釋放
+static GameMapLayout *CreateGameMapLayout(std::pmr::memory_resource *memory)
+{
+    void *p = memory->allocate(sizeof(GameMapLayout), alignof(GameMapLayout));
+    return new (p) GameMapLayout{
+        std::pmr::vector<Vector2>(memory), std::pmr::vector<int>(memory), std::pmr::vector<int>(memory), std::pmr::vector<int>(memory),
+        std::pmr::vector<int>(memory), std::pmr::vector<Vector2>(memory), std::pmr::vector<Vector2>(memory), std::pmr::vector<unsigned char>(memory),
+        std::pmr::vector<int>(memory), std::pmr::vector<int>(memory), std::pmr::vector<int>(memory) };
+}
+
+//---------------------------------------------------------------------------
+// Camera
+//---------------------------------------------------------------------------
+static Camera2D camera = {};
+static bool cameraFollow = true;            // 拖曳後停止跟隨, HOME 或移動節點時恢復
+static int drawnNodes = 0;
+static int drawnEdges = 0;
+static int hoverNode = -1;                  // 滑鼠下的節點, 用來顯示可到達的結局
+
 //---------------------------------------------------------------------------
 // Local state
 //---------------------------------------------------------------------------
 static int currentNode = 0;         // 玩家目前位於哪個節點
 static int finishScreen = 0;
-void RandGameMap(int nlevels, int maxPathsPerNode, int maxParents)
+static EncounterCache encounters;   // currentNode 各 parent 的戰鬥, 背景產生並預先模擬
+
+static unsigned int GetNodeEncounterKey(int node)
+{
+    return GetEncounterNodeKey(GetGameMapStreamDepth(mapStream, node), GetGameMapStreamSlot(mapStream, node));
+}
+
+// 節點依中心點放進所在格子 (counting sort), 查詢時看 3x3 格即可涵蓋半徑內的節點
+static void BuildPickGrid(void)
+{
+    int nodeCount = GetGameMapNodeCount(gameMap);
+    Vector2 minPos = layout->nodePos[0];
+    Vector2 maxPos = layout->nodePos[0];
+    for (int i = 0; i < nodeCount; i++)
+    {
+        minPos.x = fminf(minPos.x, layout->nodePos[i].x); minPos.y = fminf(minPos.y, layout->nodePos[i].y);
+        maxPos.x = fmaxf(maxPos.x, layout->nodePos[i].x); maxPos.y = fmaxf(maxPos.y, layout->nodePos[i].y);
+    }
+
+    gridOrigin = minPos;
+    gridCols = (int)((maxPos.x - minPos.x)/PICK_CELL_SIZE) + 1;
+    gridRows = (int)((maxPos.y - minPos.y)/PICK_CELL_SIZE) + 1;
+
+    auto CellOf = [](Vector2 p) { return (int)((p.y - gridOrigin.y)/PICK_CELL_SIZE)*gridCols + (int)((p.x - gridOrigin.x)/PICK_CELL_SIZE); };
+
+    layout->cellStart.assign(gridCols*gridRows + 1, 0);
+    for (int i = 0; i < nodeCount; i++) layout->cellStart[CellOf(layout->nodePos[i]) + 1]++;
+    for (int c = 0; c < gridCols*gridRows; c++) layout->cellStart[c + 1] += layout->cellStart[c];
+
+    layout->cellFill.assign(layout->cellStart.begin(), layout->cellStart.end() - 1);
+    layout->cellNodes.resize(nodeCount);
+    for (int i = 0; i < nodeCount; i++) layout->cellNodes[layout->cellFill[CellOf(layout->nodePos[i])]++] = i;
+}
+
+// 回傳 world 座標 pos 半徑內最近的節點, 沒有則 -1
+static int PickGameMapNode(Vector2 pos)
 {
-    game_map_tree.clear();
-    std::vector<std::vector<int>> levelIndex(nlevels + 1); // 各層節點索引 list
-    
-    int idCounter = 0;
-    
-    // 以bfs方法依序建立節點
-    levelIndex[nlevels].push_back(idCounter);
-    
-    game_map_tree.push_back({});
-    int nIdx = 0;
-    game_map_tree[nIdx].level = nlevels;
-    game_map_tree[nIdx].text = "Root " + std::to_string(idCounter);
-    idCounter++;
-
-    std::queue<int> queue;
-    queue.push(nIdx);
-    while (!queue.empty())
+    int cx = (int)floorf((pos.x - gridOrigin.x)/PICK_CELL_SIZE);
+    int cy = (int)floorf((pos.y - gridOrigin.y)/PICK_CELL_SIZE);
+
+    int best = -1;
+    float bestDist = (float)(RADIOUS*RADIOUS);
+    for (int y = cy - 1; y <= cy + 1; y++)
     {
-        nIdx = queue.front();
-        queue.pop();
-        int pathsPerNode = 1 + rand() % maxPathsPerNode;
-        if (game_map_tree[nIdx].level == 0) return;
-        if (game_map_tree[nIdx].level == 1) pathsPerNode = 1;
-        for (int i = 0; i < pathsPerNode; i++)
+        if ((y < 0) || (y >= gridRows)) continue;
+        for (int x = cx - 1; x <= cx + 1; x++)
         {
-            bool isShareNode = false;
-            if (levelIndex[game_map_tree[nIdx].level - 1].size() > 0)
+            if ((x < 0) || (x >= gridCols)) continue;
+            int cell = y*gridCols + x;
+            for (int k = layout->cellStart[cell]; k < layout->cellStart[cell + 1]; k++)
             {
-                isShareNode = rand() % 3 == 0? true : false;
-                if (game_map_tree[nIdx].level == 1) isShareNode = true;
+                int node = layout->cellNodes[k];
+                float dx = pos.x - layout->nodePos[node].x;
+                float dy = pos.y - layout->nodePos[node].y;
+                float dist = dx*dx + dy*dy;
+                if (dist < bestDist) { bestDist = dist; best = node; }
             }
+        }
+    }
+    return best;
+}
 
-            GameMapNode t;
-            if (!isShareNode)
-            {
-                t.level = game_map_tree[nIdx].level - 1;
-                // 產生名字
-                if (t.level == 0)
-                {
-                    t.text = std::string("End");
-                }
-                else
-                {
-                    t.text = "Path " + std::to_string(idCounter);
-                }
-                levelIndex[t.level].push_back(idCounter);
-                game_map_tree.push_back(t);
-                game_map_tree[nIdx].parents.push_back(idCounter);
-                queue.push(idCounter);
-                idCounter++;
-            }
-            else
-            {
-                int idx = levelIndex[game_map_tree[nIdx].level - 1][levelIndex[game_map_tree[nIdx].level - 1].size() - 1];
-                t = game_map_tree[idx];
-                game_map_tree[nIdx].parents.push_back(idx);
-            }
+// 計算節點座標、每層節點清單與所有邊的端點, 地圖改變時呼叫一次
+static void BuildGameMapLayout(void)
+{
+    int nodeCount = GetGameMapNodeCount(gameMap);
+    int minLevel = gameMap->level[0];
+    int maxLevel = gameMap->level[0];
+    for (int i = 0; i < nodeCount; i++)
+    {
+        if (gameMap->level[i] < minLevel) minLevel = gameMap->level[i];
+        if (gameMap->level[i] > maxLevel) maxLevel = gameMap->level[i];
+    }
+    int rows = maxLevel - minLevel + 1;     // 只排 window 內的層, 最上面一列為 minLevel
+
+    // counting sort: 依 level 分桶, 同層維持 index 順序
+    layout->levelStart.assign(rows + 1, 0);
+    for (int i = 0; i < nodeCount; i++) layout->levelStart[gameMap->level[i] - minLevel + 1]++;
+    for (int row = 0; row < rows; row++) layout->levelStart[row + 1] += layout->levelStart[row];
+
+    layout->levelFill.assign(layout->levelStart.begin(), layout->levelStart.end() - 1);
+    layout->levelNodes.resize(nodeCount);
+    for (int i = 0; i < nodeCount; i++) layout->levelNodes[layout->levelFill[gameMap->level[i] - minLevel]++] = i;
+
+    layoutRows = rows;
+    layoutTopY = -(float)(mapStream->totalLevels - 1 - minLevel)*LAYOUT_OFFSET_Y;
+
+    layout->nodePos.resize(nodeCount);
+    layout->labelWidth.resize(nodeCount);
+    for (int row = 0; row < rows; row++)
+    {
+        int count = layout->levelStart[row + 1] - layout->levelStart[row];
+
+        // 整層以 x = 0 置中
+        float startX = -(count - 1)*LAYOUT_OFFSET_X/2.0f;
+
+        for (int idx = 0; idx < count; idx++)
+        {
+            int node = layout->levelNodes[layout->levelStart[row] + idx];
+            layout->nodePos[node] = { startX + idx*LAYOUT_OFFSET_X, layoutTopY + row*LAYOUT_OFFSET_Y };
+            layout->labelWidth[node] = MeasureText(GetGameMapLabel(gameMap, node), 20);
+        }
+    }
+
+    // 邊端點直接查 layout->nodePos, 不用再搜尋上一層
+    layout->edgeFrom.resize(GetGameMapEdgeCount(gameMap));
+    layout->edgeTo.resize(GetGameMapEdgeCount(gameMap));
+    for (int i = 0; i < nodeCount; i++)
+    {
+        for (int e = gameMap->edgeOffset[i]; e < gameMap->edgeOffset[i + 1]; e++)
+        {
+            layout->edgeFrom[e] = layout->nodePos[i];
+            layout->edgeTo[e] = layout->nodePos[gameMap->edges[e]];
         }
     }
+
+    BuildPickGrid();
+    layout->clickable.assign(nodeCount, 0);
+}
+
+// 移動到 node: 推進串流 window (可能移出舊層、產生新層), 重算 layout 並更新可點擊標記
+// 節點編號會因移出的層而位移, 舊的 hoverNode 不再有效, 等下一次 Update 重新 pick
+static void SetCurrentNode(int node)
+{
+    int evicted = AdvanceGameMapStream(mapStream, GetGameMapStreamDepth(mapStream, node));
+    BuildGameMapLayout();
+    hoverNode = -1;
+
+    currentNode = node - evicted;
+    const int *parents = GetGameMapParents(gameMap, currentNode);
+    int parentCount = GetGameMapParentCount(gameMap, currentNode);
+    unsigned int keys[GAME_MAP_MAX_WIDTH];
+    for (int i = 0; i < parentCount; i++)
+    {
+        layout->clickable[parents[i]] = 1;
+        keys[i] = GetNodeEncounterKey(parents[i]);
+    }
+    PrefetchEncounters(&encounters, keys, parentCount);     // 沒選到的分支在這裡被放棄
+    cameraFollow = true;
+}
+
+// 玩家選定 node: 移動過去, 並把該節點的戰鬥 (就是地圖上顯示難度的那一場) 交給 GAMEPLAY 開打
+static void MoveToNode(int node)
+{
+    static Encounter encounter;
+    GetNodeEncounter(&encounters, GetNodeEncounterKey(node), &encounter);     // SetCurrentNode 之後 node 編號可能位移, 先取
+    SetCurrentNode(node);
+    HandOffEncounter(&encounter);
+    finishScreen = 2;
 }
 
-int GetTreeNodeCount() 
+// 更新鏡頭: 右鍵拖曳 / 方向鍵平移, 滾輪以滑鼠位置為中心縮放
+static void UpdateGameMapCamera(void)
 {
-    return game_map_tree.size();
+    camera.offset = { GetScreenWidth()/2.0f, GetScreenHeight()*0.7f };
+
+    float wheel = GetMouseWheelMove();
+    if (wheel != 0.0f)
+    {
+        Vector2 before = GetScreenToWorld2D(GetMousePosition(), camera);
+        camera.zoom *= (wheel > 0.0f)? 1.1f : 1.0f/1.1f;
+        if (camera.zoom < 0.1f) camera.zoom = 0.1f;
+        if (camera.zoom > 3.0f) camera.zoom = 3.0f;
+        Vector2 after = GetScreenToWorld2D(GetMousePosition(), camera);
+        camera.target.x += before.x - after.x;
+        camera.target.y += before.y - after.y;
+    }
+
+    if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT))
+    {
+        Vector2 delta = GetMouseDelta();
+        camera.target.x -= delta.x/camera.zoom;
+        camera.target.y -= delta.y/camera.zoom;
+        if ((delta.x != 0.0f) || (delta.y != 0.0f)) cameraFollow = false;
+    }
+
+    const float panSpeed = 600.0f*GetFrameTime()/camera.zoom;
+    if (IsKeyDown(KEY_LEFT)) { camera.target.x -= panSpeed; cameraFollow = false; }
+    if (IsKeyDown(KEY_RIGHT)) { camera.target.x += panSpeed; cameraFollow = false; }
+    if (IsKeyDown(KEY_UP)) { camera.target.y -= panSpeed; cameraFollow = false; }
+    if (IsKeyDown(KEY_DOWN)) { camera.target.y += panSpeed; cameraFollow = false; }
+    if (IsKeyPressed(KEY_HOME)) cameraFollow = true;
+
+    if (cameraFollow)
+    {
+        // 平滑跟隨目前節點
+        Vector2 goal = layout->nodePos[currentNode];
+        float t = fminf(1.0f, 8.0f*GetFrameTime());
+        camera.target.x += (goal.x - camera.target.x)*t;
+        camera.target.y += (goal.y - camera.target.y)*t;
+    }
 }
 //---------------------------------------------------------------------------
     // Init
     //---------------------------------------------------------------------------
 void InitGameMapScreen(void)
 {
-    printf("RandGameMap tree=%p size=%zu\n", &game_map_tree, game_map_tree.size());
     finishScreen = 0;
-    RandGameMap(5, 3, 3);
-    currentNode = 0;  // 玩家從最底部 (0 = 最後結局) 開始
-    nodePos.resize(GetTreeNodeCount());
+    ScreenArena *arena = GetScreenArena(GAME_MAP);
+    mapStream = CreateGameMapStream(arena);
+    gameMap = &mapStream->map;
+    layout = CreateGameMapLayout(arena);
+    InitGameMapStream(mapStream, (unsigned int)GetRandomValue(0, 0x7fffffff), runLevels, 3);
+    TraceLog(LOG_INFO, "GAMEMAP: seed %u, %i levels, window %i nodes, %i edges, %i bytes", mapStream->seed, runLevels,
+        GetGameMapNodeCount(gameMap), GetGameMapEdgeCount(gameMap), (int)GetGameMapMemoryUsage(gameMap));
+    currentNode = 0;  // 玩家從 Root 開始
+    hoverNode = -1;
+    StartEncounterCache(&encounters, mapStream->seed);
+    SetCurrentNode(0);
+
+    camera.target = layout->nodePos[currentNode];
+    camera.offset = { GetScreenWidth()/2.0f, GetScreenHeight()*0.7f };
+    camera.rotation = 0.0f;
+    camera.zoom = 1.0f;
 }
 
 //---------------------------------------------------------------------------
@@ -133,38 +307,36 @@ void UpdateGameMapScreen(void)
         return;
     }
 
+    UpdateGameMapCamera();
+    UpdateEncounterCache(&encounters);
+
     // 按 1 / 2 / 3 選擇父節點
-    if (IsKeyPressed(KEY_ONE) && game_map_tree[currentNode].parents.size() >= 1) {
-        currentNode = game_map_tree[currentNode].parents[0];
+    const int *parents = GetGameMapParents(gameMap, currentNode);
+    int parentCount = GetGameMapParentCount(gameMap, currentNode);
+    if (IsKeyPressed(KEY_ONE) && parentCount >= 1) {
+        MoveToNode(parents[0]);
+        return;
     }
-    if (IsKeyPressed(KEY_TWO) && game_map_tree[currentNode].parents.size() >= 2) {
-        currentNode = game_map_tree[currentNode].parents[1];
+    if (IsKeyPressed(KEY_TWO) && parentCount >= 2) {
+        MoveToNode(parents[1]);
+        return;
     }
-    if (IsKeyPressed(KEY_THREE) && game_map_tree[currentNode].parents.size() >= 3) {
-        currentNode = game_map_tree[currentNode].parents[2];
+    if (IsKeyPressed(KEY_THREE) && parentCount >= 3) {
+        MoveToNode(parents[2]);
+        return;
     }
 
-    Vector2 mouse = GetMousePosition();
+    // 點選: 經由空間索引找到滑鼠下的節點, 只接受目前節點的 parents
+    hoverNode = PickGameMapNode(GetScreenToWorld2D(GetMousePosition(), camera));
     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-        // 遍歷目前節點的父節點，看有沒有被點到
-        for (int i = 0; i < game_map_tree[currentNode].parents.size(); i++) {
-            int parentId = game_map_tree[currentNode].parents[i];
-            Vector2 pos = nodePos[parentId];
-
-            float dx = mouse.x - pos.x;
-            float dy = mouse.y - pos.y;
-            float dist = sqrtf(dx * dx + dy * dy);
-
-            if (dist < RADIOUS) {  // 圓半徑 = 32
-                currentNode = parentId;
-                return;
-            }
+        if ((hoverNode >= 0) && layout->clickable[hoverNode]) {
+            MoveToNode(hoverNode);
+            return;
         }
     }
 
-
-    // 到頂端 Root
-    if (game_map_tree[currentNode].parents.size() == 0 && currentNode != 0) {
+    // 走到結局
+    if (GetGameMapStreamDepth(mapStream, currentNode) == mapStream->totalLevels - 1) {
         finishScreen = 1;
     }
 }
@@ -176,80 +348,122 @@ void DrawGameMapScreen(void)
 {
     ClearBackground(RAYWHITE);
 
-    DrawText("Tree Choice Game", 20, 20, 28, DARKGRAY);
-    DrawText("Press 1/2/3 to go up | SPACE to skip", 20, 60, 20, GRAY);
-
-    // 找出每一層節點
-    int maxLevel = 0;
-    for (int i = 0; i < GetTreeNodeCount(); i++) if (game_map_tree[i].level > maxLevel) maxLevel = game_map_tree[i].level;
-    std::vector<std::vector<int>> levels(maxLevel + 1);
-
-    for (int i = 0; i < GetTreeNodeCount(); i++) 
-    {
-        levels[game_map_tree[i].level].push_back(i);
+    // 可見範圍 (world), 外擴一個半徑讓邊緣的圓不會被切掉
+    Vector2 viewMin = GetScreenToWorld2D({ 0.0f, 0.0f }, camera);
+    Vector2 viewMax = GetScreenToWorld2D({ (float)GetScreenWidth(), (float)GetScreenHeight() }, camera);
+    viewMin.x -= RADIOUS; viewMin.y -= RADIOUS;
+    viewMax.x += RADIOUS; viewMax.y += RADIOUS;
+
+    // 列依 y 等距排列, 直接算出可見列範圍
+    int rowFirst = (int)ceilf((viewMin.y - layoutTopY)/LAYOUT_OFFSET_Y);
+    int rowLast = (int)floorf((viewMax.y - layoutTopY)/LAYOUT_OFFSET_Y);
+    if (rowFirst < 0) rowFirst = 0;
+    if (rowLast > layoutRows - 1) rowLast = layoutRows - 1;
+
+    drawnNodes = 0;
+    drawnEdges = 0;
+
+    // 可到達集合已由 AnalyzeStreamWindow 算好, 直接查 bitmask
+    if (hoverNode >= GetGameMapNodeCount(gameMap)) hoverNode = -1;   // 保險: window 縮小後舊的編號可能越界
+    int focusNode = (hoverNode >= 0)? hoverNode : currentNode;
+    unsigned long long reachable = mapStream->analysis.reachMask[focusNode];
+
+    BeginMode2D(camera);
+
+    // --- Draw edges (parent lines), 端點已在 BuildGameMapLayout 解析好
+    // 列內節點 index 連續, 所以一列的邊在 CSR 中也是連續區段; 邊從第 r 列連到第 r - 1 列
+    for (int row = rowFirst; (row <= rowLast + 1) && (row < layoutRows); row++) {
+        if (layout->levelStart[row] == layout->levelStart[row + 1]) continue;
+        int firstNode = layout->levelNodes[layout->levelStart[row]];
+        int lastNode = layout->levelNodes[layout->levelStart[row + 1] - 1];
+        for (int e = gameMap->edgeOffset[firstNode]; e < gameMap->edgeOffset[lastNode + 1]; e++) {
+            if ((fmaxf(layout->edgeFrom[e].x, layout->edgeTo[e].x) < viewMin.x) || (fminf(layout->edgeFrom[e].x, layout->edgeTo[e].x) > viewMax.x)) continue;
+            DrawLineV(layout->edgeFrom[e], layout->edgeTo[e], LIGHTGRAY);
+            drawnEdges++;
+        }
     }
 
-    int baseY = 150;
-    int offsetY = 100;
-    int offsetX = 120;
-
-    // 對每一層
-    for (int lvl = 0; lvl <= maxLevel; lvl++) {
-        int count = levels[lvl].size();
-        if (count == 0) continue;
-
-        // 這層起始 X，讓整層置中
-        int totalWidth = (count - 1) * offsetX;
-        int startX = GetScreenWidth() / 2 - totalWidth / 2;
-
-        for (int idx = 0; idx < count; idx++) {
-            int node = levels[lvl][idx];
-
-            int x = startX + idx * offsetX;
-            int y = baseY + lvl * offsetY;
-            nodePos[node] = { (float)x, (float)y };  // ✅ 記住節點座標
-
-            // --- Draw edges (parent lines)
-            for (int p : game_map_tree[node].parents) {
-                // 找父節點位置 (需要搜尋)
-                for (int idx2 = 0; idx2 < levels[lvl-1].size(); idx2++) {
-                    int candidate = levels[lvl - 1][idx2];
-                    if (candidate == p) {
-                        int px = GetScreenWidth() / 2 - ((levels[lvl - 1].size() - 1) * offsetX) / 2 + idx2 * offsetX;
-                        int py = baseY + (lvl - 1) * offsetY;
-                        DrawLine(x, y, px, py, LIGHTGRAY);
-                    }
-                }
-            }
+    // --- Draw nodes
+    for (int row = rowFirst; row <= rowLast; row++) {
+        for (int k = layout->levelStart[row]; k < layout->levelStart[row + 1]; k++) {
+            int node = layout->levelNodes[k];
+            if ((layout->nodePos[node].x < viewMin.x) || (layout->nodePos[node].x > viewMax.x)) continue;
+
+            int x = (int)layout->nodePos[node].x;
+            int y = (int)layout->nodePos[node].y;
 
-            // --- Draw nodes
             Color c = (node == currentNode) ? RED : BLACK;
             Color fill = (node == currentNode) ? PINK : RAYWHITE;
 
             DrawCircle(x, y, RADIOUS, fill);
             DrawCircleLines(x, y, RADIOUS, c);
 
-            bool clickable = false;
-            for (int p : game_map_tree[currentNode].parents)
-                if (p == node) clickable = true;
-
-            if (clickable)
+            if (layout->clickable[node]) {
                 DrawCircleLines(x, y, RADIOUS + 4, ORANGE); // highlight clickable nodes
 
-            int textWidth = MeasureText(game_map_tree[node].text.c_str(), 20);
-            DrawText(game_map_tree[node].text.c_str(), x - textWidth / 2, y - 10, 20, c);
+                // 預先模擬的勝率, 還沒算好時顯示 "..."
+                EncounterSummary summary;
+                if (GetEncounterSummary(&encounters, GetNodeEncounterKey(node), &summary)) {
+                    static const Color difficultyColors[3] = { DARKGREEN, ORANGE, MAROON };
+                    const char *text = TextFormat("%d%%", summary.blueWins * 100 / summary.runs);
+                    DrawText(text, x - MeasureText(text, 18) / 2, y + RADIOUS + 8, 18, difficultyColors[GetEncounterDifficulty(&summary)]);
+                }
+                else DrawText("...", x - MeasureText("...", 18) / 2, y + RADIOUS + 8, 18, GRAY);
+            }
+            else if ((node != focusNode) && (reachable & (1ull << node)))
+                DrawCircleLines(x, y, RADIOUS + 4, SKYBLUE); // highlight nodes reachable from focus
+
+            DrawText(GetGameMapLabel(gameMap, node), x - layout->labelWidth[node] / 2, y - 10, 20, c);
+            drawnNodes++;
         }
     }
 
+    EndMode2D();
+
+    DrawText("Tree Choice Game", 20, 20, 28, DARKGRAY);
+    DrawText("Press 1/2/3 or click to fight the next battle | RMB drag / arrows to pan, wheel to zoom, HOME to recenter | SPACE to skip", 20, 60, 20, GRAY);
+    DrawText(TextFormat("Drawn: %i/%i nodes, %i/%i edges", drawnNodes, GetGameMapNodeCount(gameMap), drawnEdges, GetGameMapEdgeCount(gameMap)), 20, 90, 20, GRAY);
+
+    // 分析結果
+    const GameMapAnalysis *analysis = &mapStream->analysis;
+    DrawText(TextFormat("%s: %llu paths from root, %i steps left", GetGameMapLabel(gameMap, focusNode),
+        analysis->pathsFromRoot[focusNode], gameMap->level[focusNode]), 20, 120, 20, DARKBLUE);
+
+    // 暫存字串放在 frame arena, 這個 frame 結束就失效
+    unsigned int endings = GetGameMapReachableEndings(mapStream, focusNode);
+    std::pmr::string endingText("Reachable endings:", GetFrameArena());
+    for (int slot = 0; endings >> slot; slot++)
+    {
+        if (!(endings & (1u << slot))) continue;
+        endingText += ' ';
+        endingText += GetGameMapEndingLetter(slot);
+    }
+    DrawText(endingText.c_str(), 20, 145, 20, DARKBLUE);
+
+    // 滑鼠指著的下一步: 預先模擬的戰鬥摘要
+    EncounterSummary summary;
+    if ((hoverNode >= 0) && layout->clickable[hoverNode] && GetEncounterSummary(&encounters, GetNodeEncounterKey(hoverNode), &summary)) {
+        DrawText(TextFormat("Battle: %s, win %d%%, ~%.1f losses, ~%.1f turns", GetEncounterDifficultyName(GetEncounterDifficulty(&summary)),
+            summary.blueWins * 100 / summary.runs, (float)summary.blueLosses / summary.runs,
+            (summary.finished > 0) ? (float)summary.totalTicks / summary.finished / SCHEDULER_TICKS_PER_TURN : 0.0f), 20, 170, 20, DARKBLUE);
+    }
+
     // Show current selection
     DrawText("Current:", 50, GetScreenHeight() - 120, 22, BLACK);
-    DrawText(game_map_tree[currentNode].text.c_str(), 140, GetScreenHeight() - 120, 24, BLUE);
+    DrawText(GetGameMapLabel(gameMap, currentNode), 140, GetScreenHeight() - 120, 24, BLUE);
 }
 
 //---------------------------------------------------------------------------
 // Unload
 //---------------------------------------------------------------------------
-void UnloadGameMapScreen(void) {}
+// container 都在 screen arena 上, 由 ReleaseScreenArena 一次釋放, 這裡只放掉指標
+void UnloadGameMapScreen(void)
+{
+    StopEncounterCache(&encounters);
+    mapStream = NULL;
+    gameMap = NULL;
+    layout = NULL;
+}
 
 //---------------------------------------------------------------------------
 // End?
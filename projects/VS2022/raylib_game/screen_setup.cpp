@@ -1,5 +1,13 @@
 ﻿#include "raylib.h"
 #include "screens.h"
+#include "game_unit.h"
+#include "battle_units.h"
+#include "battle_scheduler.h"
+#include "battle_los.h"
+#include "battle_setup_sim.h"
+#include "battle_preview.h"
+#include "battle_formation.h"
+#include "battle_mcts.h"
 #include <stdlib.h>
 #include <math.h>
 #include <algorithm>
@@ -9,34 +17,31 @@
 #define GRID_WIDTH 8
 #define GRID_HEIGHT 16
 #define CELL_SIZE 45
-#define MAX_UNITS 64
+#define RED_UNIT_COUNT 5
+#define RED_ZONE_ROWS 4                     // 紅隊只佈陣在最上面幾排
 
-typedef enum { TEAM_RED, TEAM_BLUE } Team;
 typedef enum { STATE_PLACING, STATE_BATTLE } GameState;
 
-typedef struct Unit {
-    int x, y;
-    int hp;
-    int attack;
-    Team team;
-    bool alive;
-} Unit;
-
 typedef struct UnitType {
-    const char* name;
-    int hp;
-    int attack;
+    int type;       // GameData::AllUnits index
     int count;
 } UnitType;
 
-static Unit units[MAX_UNITS];
-static int unitCount = 0;
+static UnitStore units;                     // 放置中的配置
+static SetupBattle battle;                  // 開打後的戰場 (由 units 複製)
+static OutcomePreview preview;              // 放置時在背景估計的勝率
+static LineOfSightTable lineOfSight;
+static FormationSearchConfig redConfig;
+static FormationSearch redSearch;           // 紅隊陣形在背景搜尋, 完成前不能放置
+static bool redDeployed = false;
+static MctsController blueAI;               // 開啟時藍隊由 MCTS 指揮, 否則照預設行動
+static bool blueAIEnabled = false;
+static float battleClock = 0.0f;            // 戰鬥時間 (tick)
 static int grid[GRID_HEIGHT][GRID_WIDTH] = { 0 };
 
 static int framesCounter = 0;
 static int finishScreen = 0;
-static float turnTimer = 0.0f;
-static const float TURN_INTERVAL = 1.0f;
+static const float TURN_INTERVAL = 1.0f;     // 速度 1 的單位每 TURN_INTERVAL 秒行動一次
 static bool gameOver = false;
 static Team winner;
 
@@ -47,11 +52,12 @@ static const int INFO_PANEL_WIDTH = 220;
 static GameState state = STATE_PLACING;
 static int selectedTypeIndex = -1;
 
-// 玩家可放的單位種類
+// 玩家可放的單位種類 (數值來自 GameData::AllUnits)
+static const int playerUnitLevel = 1;
 static UnitType playerTypes[] = {
-    {"Warrior", 12, 3, 3},
-    {"Archer",  8,  4, 2},
-    {"Knight", 16,  2, 2}
+    {GameData::UNIT_FOOTMAN, 3},
+    {GameData::UNIT_ARCHER,  2},
+    {GameData::UNIT_KNIGHT,  2}
 };
 static const int playerTypeCount = sizeof(playerTypes) / sizeof(playerTypes[0]);
 
@@ -60,47 +66,37 @@ static bool IsOccupied(int x, int y)
 {
     if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) return true;
     if (grid[y][x] == 1) return true;
-    for (int i = 0; i < unitCount; i++)
-        if (units[i].alive && units[i].x == x && units[i].y == y)
-            return true;
-    return false;
+    return FindUnitAt(&units, x, y) >= 0;
 }
 
-static int Distance(Unit* a, Unit* b)
-{
-    return abs(a->x - b->x) + abs(a->y - b->y);
-}
-
-//-------------------------------------------------------------
-//bool UnitSort(const Unit& a, const Unit& b)
-//{
-//    if (a.team != b.team) return a.team == TEAM_BLUE;
-//    if (a.team == TEAM_BLUE) return a.y < b.y;
-//    return a.y > b.y;
-//}
-
-static Unit* FindNearestEnemy(Unit* u)
+// 玩家可能的配置: 近戰單位放在最後四排的前兩排, 遠程放在最後兩排
+static void BuildLikelyBlueFormation(UnitStore* store)
 {
-    Unit* target = NULL;
-    int minDist = 999;
-    for (int i = 0; i < unitCount; i++) {
-        Unit* e = &units[i];
-        if (!e->alive || e->team == u->team) continue;
-        int d = Distance(u, e);
-        if (d < minDist) { minDist = d; target = e; }
+    InitUnitStore(store);
+    for (int i = 0; i < playerTypeCount; i++) {
+        int type = playerTypes[i].type;
+        bool ranged = GameData::GetUnitRange(type, playerUnitLevel) > FIXED_ONE;
+        int rowBegin = ranged ? GRID_HEIGHT - 2 : GRID_HEIGHT - 4;
+        for (int n = 0; n < playerTypes[i].count; n++) {
+            for (int tries = 0; tries < 32; tries++) {
+                int x = GetRandomValue(0, GRID_WIDTH - 1);
+                int y = GetRandomValue(rowBegin, rowBegin + 1);
+                if (FindUnitAt(store, x, y) < 0) { AddCatalogUnit(store, TEAM_BLUE, x, y, type, playerUnitLevel); break; }
+            }
+        }
     }
-    return target;
 }
 
-static void MoveTowards(Unit* u, Unit* target)
+static void DeployRedFormation(void)
 {
-    int dx = target->x - u->x;
-    int dy = target->y - u->y;
-    int stepX = (dx != 0) ? dx / abs(dx) : 0;
-    int stepY = (dy != 0) ? dy / abs(dy) : 0;
-    int nx = u->x + stepX;
-    int ny = u->y + stepY;
-    if (!IsOccupied(nx, ny)) { u->x = nx; u->y = ny; }
+    const UnitStore* red = &redConfig.red;
+    for (int i = 0; i < red->count[TEAM_RED]; i++) {
+        int cell = redSearch.best.cell[i];
+        int r = GetTeamBegin(TEAM_RED) + i;
+        if (cell >= 0 && !IsOccupied(cell % GRID_WIDTH, cell / GRID_WIDTH))
+            AddUnit(&units, TEAM_RED, cell % GRID_WIDTH, cell / GRID_WIDTH, red->hp[r], red->attack[r], red->speed[r], red->range[r], red->type[r]);
+    }
+    redDeployed = true;
 }
 
 //-------------------------------------------------------------
@@ -109,20 +105,30 @@ void InitSetupScreen(void)
     framesCounter = 0;
     finishScreen = 0;
     gameOver = false;
-    unitCount = 0;
+    InitUnitStore(&units);
     state = STATE_PLACING;
     selectedTypeIndex = -1;
 
     boardOffsetX = (GetScreenWidth() - INFO_PANEL_WIDTH * 2 - GRID_WIDTH * CELL_SIZE) / 2 + INFO_PANEL_WIDTH;
     boardOffsetY = (GetScreenHeight() - GRID_HEIGHT * CELL_SIZE) / 2;
-
-    // 生成敵方（紅隊）
-    for (int i = 0; i < 5; i++) {
-        int rx = GetRandomValue(0, GRID_WIDTH - 1);
-        int ry = GetRandomValue(0, 3);
-        if (!IsOccupied(rx, ry))
-            units[unitCount++] = { rx, ry, 10, 3, TEAM_RED, true };
-    }
+    BuildLineOfSightTable(&lineOfSight, &grid[0][0], GRID_WIDTH, GRID_HEIGHT);
+    StartOutcomePreview(&preview, &lineOfSight, &grid[0][0], GRID_WIDTH, GRID_HEIGHT);
+    InitMctsController(&blueAI, TEAM_BLUE, MCTS_TURN_BUDGET, (unsigned int)GetRandomValue(1, 0x7fffffff));
+
+    // 生成敵方（紅隊）: 陣容固定, 位置對玩家可能的配置做搜尋
+    redConfig.lineOfSight = &lineOfSight;
+    redConfig.walls = &grid[0][0];
+    redConfig.width = GRID_WIDTH;
+    redConfig.height = GRID_HEIGHT;
+    InitUnitStore(&redConfig.red);
+    for (int i = 0; i < RED_UNIT_COUNT; i++)
+        AddUnit(&redConfig.red, TEAM_RED, 0, 0, IntToFixed(10), IntToFixed(3), 1, 1, GameData::UNIT_FOOTMAN);
+    redConfig.redRows = RED_ZONE_ROWS;
+    redConfig.blueSampleCount = FORMATION_BLUE_SAMPLES;
+    for (int b = 0; b < FORMATION_BLUE_SAMPLES; b++) BuildLikelyBlueFormation(&redConfig.blueSamples[b]);
+    redConfig.seed = (unsigned int)GetRandomValue(1, 0x7fffffff);
+    redDeployed = false;
+    StartFormationSearch(&redSearch, &redConfig);
 }
 
 //-------------------------------------------------------------
@@ -136,6 +142,12 @@ void UpdateSetupScreen(void)
     // === 放置階段 ===
     if (state == STATE_PLACING)
     {
+        // 紅隊還在佈陣
+        if (!redDeployed) {
+            if (!UpdateFormationSearch(&redSearch)) return;
+            DeployRedFormation();
+        }
+
         Vector2 m = GetMousePosition();
 
         // 點選右方單位種類
@@ -158,20 +170,33 @@ void UpdateSetupScreen(void)
                 if (!IsOccupied(gx, gy) && selectedTypeIndex >= 0) {
                     UnitType* t = &playerTypes[selectedTypeIndex];
                     if (t->count > 0) {
-                        units[unitCount++] = { gx, gy, t->hp, t->attack, TEAM_BLUE, true };
+                        AddCatalogUnit(&units, TEAM_BLUE, gx, gy, t->type, playerUnitLevel);
                         t->count--;
+                        RequestOutcomePreview(&preview, &units);
                     }
                 }
             }
         }
 
+        if (IsKeyPressed(KEY_M)) blueAIEnabled = !blueAIEnabled;
+#if defined(BATTLE_BENCHMARK)
+        if (IsKeyPressed(KEY_B)) RunMctsBenchmark();     // 會卡住畫面好幾秒, 只在開發時手動跑
+#endif
+
         // 所有單位放完才能開始
         bool allEmpty = true;
         for (int i = 0; i < playerTypeCount; i++)
             if (playerTypes[i].count > 0) allEmpty = false;
 
-        if (allEmpty && IsKeyPressed(KEY_SPACE))
+        if (allEmpty && IsKeyPressed(KEY_SPACE)) {
+            // 先攻順序隨機, 預覽估計的就是這個分佈; 開打後不再顯示預覽, 背景的模擬直接停掉
+            StopOutcomePreview(&preview);
+            StartSetupBattle(&battle, &units, &lineOfSight, &grid[0][0], GRID_WIDTH, GRID_HEIGHT, (unsigned int)GetRandomValue(1, 0x7fffffff));
+            battleClock = 0.0f;
             state = STATE_BATTLE;
+        }
+
+        UpdateOutcomePreview(&preview);
 
         return;
     }
@@ -179,36 +204,11 @@ void UpdateSetupScreen(void)
     // === 戰鬥階段 ===
     if (state == STATE_BATTLE)
     {
-        turnTimer += GetFrameTime();
-        if (turnTimer >= TURN_INTERVAL) {
-            turnTimer = 0.0f;
-            // std::sort(units, units + unitCount, UnitSort);
-            for (int i = 0; i < unitCount; i++) {
-                Unit* u = &units[i];
-                if (!u->alive) continue;
-                Unit* enemy = FindNearestEnemy(u);
-                if (!enemy) continue;
-                int dist = Distance(u, enemy);
-                if (dist == 1) {
-                    enemy->hp -= u->attack;
-                    if (enemy->hp <= 0) enemy->alive = false;
-                }
-                else {
-                    MoveTowards(u, enemy);
-                }
-            }
-
-            bool redAlive = false, blueAlive = false;
-            for (int i = 0; i < unitCount; i++) {
-                if (units[i].alive) {
-                    if (units[i].team == TEAM_RED) redAlive = true;
-                    else blueAlive = true;
-                }
-            }
-            if (!redAlive || !blueAlive) {
-                gameOver = true;
-                winner = redAlive ? TEAM_RED : TEAM_BLUE;
-            }
+        battleClock += GetFrameTime()/TURN_INTERVAL*SCHEDULER_TICKS_PER_TURN;
+        bool over = blueAIEnabled ? StepMctsBattle(&battle, &blueAI, (int)battleClock) : StepSetupBattle(&battle, (int)battleClock);
+        if (over) {
+            gameOver = true;
+            winner = battle.winner;
         }
     }
 }
@@ -219,6 +219,30 @@ void DrawPlacementUI(void)
     DrawText("Place Your Units", GetScreenWidth() / 2 - 120, 20, 24, DARKBLUE);
     DrawText("Click board to place", GetScreenWidth() / 2 - 100, 50, 20, GRAY);
     DrawText("Press SPACE to start", GetScreenWidth() / 2 - 100, 70, 20, GRAY);
+    DrawText(TextFormat("Press M: blue AI %s", blueAIEnabled ? "MCTS" : "Greedy"), GetScreenWidth() / 2 - 100, 90, 20, GRAY);
+}
+
+// 右側面板下方: 目前配置的勝率預估
+static void DrawOutcomeEstimate(int x, int y)
+{
+    if (units.count[TEAM_BLUE] == 0) {
+        DrawText("Place units to", x, y, 18, WHITE);
+        DrawText("preview the odds", x, y + 22, 18, WHITE);
+        return;
+    }
+
+    OutcomeEstimate estimate = GetOutcomeEstimate(&preview);
+    if (estimate.runs == 0) {
+        DrawText("Estimating...", x, y, 18, WHITE);
+        return;
+    }
+
+    DrawText(TextFormat("Win chance: %d%%", estimate.wins * 100 / estimate.runs), x, y, 20, YELLOW);
+    if (estimate.finished > 0)
+        DrawText(TextFormat("Avg turns: %.1f", (float)estimate.totalTicks / estimate.finished / SCHEDULER_TICKS_PER_TURN), x, y + 24, 18, WHITE);
+    else
+        DrawText("Avg turns: -", x, y + 24, 18, WHITE);
+    DrawText(TextFormat("%d/%d runs", estimate.runs, PREVIEW_SEED_COUNT), x, y + 46, 16, LIGHTGRAY);
 }
 
 //-------------------------------------------------------------
@@ -238,14 +262,15 @@ void DrawSetupScreen(void)
         }
 
     // 單位
-    for (int i = 0; i < unitCount; i++) {
-        Unit* u = &units[i];
-        if (!u->alive) continue;
-        Color color = (u->team == TEAM_RED) ? RED : BLUE;
-        int cx = boardOffsetX + u->x * CELL_SIZE + CELL_SIZE / 2;
-        int cy = boardOffsetY + u->y * CELL_SIZE + CELL_SIZE / 2;
-        DrawCircle(cx, cy, 10, color);
-        DrawText(TextFormat("%d", u->hp), cx - 8, cy - 8, 14, WHITE);
+    const UnitStore* shown = (state == STATE_BATTLE) ? &battle.units : &units;
+    for (int t = 0; t < TEAM_COUNT; t++) {
+        Color color = (t == TEAM_RED) ? RED : BLUE;
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(shown, (Team)t); i++) {
+            int cx = boardOffsetX + shown->x[i] * CELL_SIZE + CELL_SIZE / 2;
+            int cy = boardOffsetY + shown->y[i] * CELL_SIZE + CELL_SIZE / 2;
+            DrawCircle(cx, cy, 10, color);
+            DrawText(TextFormat("%d", FixedCeilToInt(shown->hp[i])), cx - 8, cy - 8, 14, WHITE);
+        }
     }
 
     // === 右側面板（可選單位） ===
@@ -269,21 +294,32 @@ void DrawSetupScreen(void)
         }
         DrawRectangleRec(r, boxColor);
         DrawRectangleLinesEx(r, 2, WHITE);
-        DrawText(playerTypes[i].name, r.x + 10, r.y + 10, 20, WHITE);
-        DrawText(TextFormat("HP:%d ATK:%d", playerTypes[i].hp, playerTypes[i].attack), r.x + 10, r.y + 30, 16, WHITE);
+        int type = playerTypes[i].type;
+        DrawText(GameData::AllUnits[type].name.data(), r.x + 10, r.y + 10, 20, WHITE);
+        DrawText(TextFormat("HP:%d ATK:%d", FixedCeilToInt(GameData::GetUnitHp(type, playerUnitLevel)), FixedRoundToInt(GameData::GetUnitAtk(type, playerUnitLevel))), r.x + 10, r.y + 30, 16, WHITE);
         DrawText(TextFormat("x%d", playerTypes[i].count), r.x + 140, r.y + 30, 18, YELLOW);
     }
 
-    if (state == STATE_PLACING) DrawPlacementUI();
+    if (state == STATE_PLACING) {
+        DrawPlacementUI();
+        if (!redDeployed) DrawText("Deploying...", 20, 40, 20, WHITE);
+        DrawOutcomeEstimate(GetScreenWidth() - INFO_PANEL_WIDTH + 20, 120 + playerTypeCount * 80 + 10);
+    }
 
     if (gameOver) {
         const char* text = (winner == TEAM_RED) ? "RED WINS!" : "BLUE WINS!";
         DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), Fade(BLACK, 0.6f));
         DrawText(text, GetScreenWidth() / 2 - MeasureText(text, 60) / 2, GetScreenHeight() / 2 - 40, 60, YELLOW);
         DrawText("Press ENTER to return", GetScreenWidth() / 2 - 150, GetScreenHeight() / 2 + 40, 20, WHITE);
+        if (battle.stalemate) DrawText("Stalemate - decided by total HP", GetScreenWidth() / 2 - MeasureText("Stalemate - decided by total HP", 20) / 2, GetScreenHeight() / 2 + 70, 20, WHITE);
     }
 }
 
 //-------------------------------------------------------------
-void UnloadSetupScreen(void) { }
+void UnloadSetupScreen(void)
+{
+    StopFormationSearch(&redSearch);
+    StopOutcomePreview(&preview);
+    StopMctsController(&blueAI);
+}
 int FinishSetupScreen(void) { return finishScreen; }
@@ -14,6 +14,8 @@
 
 #include "raylib.h"
 #include "screens.h"    // NOTE: Declares global (extern) variables and screens functions
+#include "screen_arena.h"
+#include "memory_stats.h"   // NOTE: Heap instrumentation, only active when MEMORY_STATS is defined
 
 #if defined(PLATFORM_WEB)
     #include <emscripten/emscripten.h>
@@ -97,6 +99,9 @@ int main(void)
 
     // Setup and init first screen
     currentScreen = LOGO;
+#if defined(MEMORY_STATS)
+    SetMemoryStatsScope(LOGO, MEMORY_PHASE_TRANSITION);
+#endif
     InitLogoScreen();
 
 #if defined(PLATFORM_WEB)
@@ -114,7 +119,15 @@ int main(void)
 
     // De-Initialization
     //--------------------------------------------------------------------------------------
+#if defined(MEMORY_STATS)
+    SetMemoryStatsScope(currentScreen, MEMORY_PHASE_TRANSITION);
+#endif
     screens[currentScreen].Unload();
+    ReleaseScreenArena(currentScreen);
+
+#if defined(MEMORY_STATS)
+    if (WriteMemoryStatsCsv("memory_stats.csv")) TraceLog(LOG_INFO, "MEMORY: stats written to memory_stats.csv");
+#endif
 
     // Unload global data loaded
     UnloadFont(font);
@@ -156,9 +169,16 @@ static void UpdateTransition(void)
             transAlpha = 1.0f;
 
             // Unload current screen
+#if defined(MEMORY_STATS)
+            SetMemoryStatsScope(transFromScreen, MEMORY_PHASE_TRANSITION);
+#endif
             screens[transFromScreen].Unload();
+            ReleaseScreenArena(transFromScreen);    // O(1): everything the screen allocated goes at once
 
             // Load next screen
+#if defined(MEMORY_STATS)
+            SetMemoryStatsScope(transToScreen, MEMORY_PHASE_TRANSITION);
+#endif
             screens[transToScreen].Init();
 
             currentScreen = transToScreen;
@@ -195,6 +215,9 @@ static void UpdateDrawFrame(void)
     // Update
     //----------------------------------------------------------------------------------
     //UpdateMusicStream(music);       // NOTE: Music keeps playing between screens
+#if defined(MEMORY_STATS)
+    SetMemoryStatsScope(currentScreen, MEMORY_PHASE_UPDATE);
+#endif
 
     if (!onTransition)
     {
@@ -226,7 +249,8 @@ static void UpdateDrawFrame(void)
             case GAME_MAP:
             {
                 UpdateGameMapScreen();
-                if (FinishGameMapScreen()) TransitionToScreen(TITLE);
+                if (FinishGameMapScreen() == 1) TransitionToScreen(TITLE);
+                else if (FinishGameMapScreen() == 2) TransitionToScreen(GAMEPLAY);     // 選定節點, 打該節點的戰鬥
             } break;
             case GAMEPLAY:
             {
@@ -251,6 +275,9 @@ static void UpdateDrawFrame(void)
 
     // Draw
     //----------------------------------------------------------------------------------
+#if defined(MEMORY_STATS)
+    SetMemoryStatsScope(currentScreen, MEMORY_PHASE_DRAW);
+#endif
     BeginDrawing();
 
         ClearBackground(RAYWHITE);
@@ -261,7 +288,15 @@ static void UpdateDrawFrame(void)
         if (onTransition) DrawTransition();
 
         DrawFPS(10, 10);
+#if defined(MEMORY_STATS)
+        DrawMemoryStatsOverlay(10, 40);
+#endif
         
     EndDrawing();
     //----------------------------------------------------------------------------------
+
+    ResetFrameArena();      // Per-frame scratch memory is only valid until the frame ends
+#if defined(MEMORY_STATS)
+    EndMemoryStatsFrame();
+#endif
 }
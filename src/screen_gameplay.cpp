@@ -2,30 +2,60 @@
 #include "screens.h"
 #include <stdlib.h>
 #include <math.h>
+#include <assert.h>
 #include <algorithm>
-#include <queue>
+#include "game_unit.h"
+#include "battle_units.h"
+#include "battle_scheduler.h"
+#include "battle_los.h"
+#include "battle_influence.h"
+#include "battle_path.h"
+#include "battle_terrain.h"
+#include "battle_fog.h"
+#include "battle_zobrist.h"
+#include "battle_grid_search.h"
+#include "battle_encounter.h"
+#include "battle_engine.h"
+#include "memory_stats.h"
 
 #define GRID_WIDTH 8
 #define GRID_HEIGHT 16
 #define CELL_SIZE 45
 #define MAX_UNITS 32
 
-typedef enum { TEAM_RED, TEAM_BLUE } Team;
-
-typedef struct Unit {
-    int x, y;
-    int hp;
-    int attack;
-    Team team;
-    bool alive;
-} Unit;
-
-typedef struct GamePlayNode {
-    int x, y;
-} GamePlayNode;
-
-static Unit units[MAX_UNITS];
-static int unitCount = 0;
+static_assert((GRID_WIDTH == ENCOUNTER_GRID_WIDTH) && (GRID_HEIGHT == ENCOUNTER_GRID_HEIGHT) && (MAX_UNITS == ENCOUNTER_TEAM_UNITS*2), "encounters are generated for this board");
+
+// GameplayEngine 的 State: BattleState 的欄位 (battle_engine.h) 加上 GAMEPLAY 的 policy 用到的尋路 / 視野 / hash,
+// policy 與下面的輔助函數只透過傳進來的 state 存取這些資料
+typedef struct GameplayBattle {
+    UnitStore units;
+    ActionScheduler scheduler;
+    const LineOfSightTable *lineOfSight;
+    bool over;
+    Team winner;
+    int endTime;
+
+    const int *walls;                       // GRID_WIDTH*GRID_HEIGHT 的地形
+    InfluenceMap influence;                 // 各隊支援 / 威脅圖, 每回合第一次移動時重算
+    Fixed cellSafety[TEAM_COUNT][GRID_HEIGHT*GRID_WIDTH];
+    int influenceTurn;                      // influence / cellSafety 是第幾回合算的
+    mutable PathPlanner planner;            // 共用的時空預約表 + A* / 距離場暫存 (Perceive 拿 const state 也要算距離場)
+    GridSearch gridSearch;                  // DistanceWithBFS / MoveTowards 共用的 BFS 暫存
+    FogOfWar fog;                           // 各隊視野, 每次行動後只重算移動過的單位
+    uint64_t hash;                          // 單位位置 + hp 的 Zobrist hash, 移動 / 受傷時增量更新
+    RepetitionTable repetitions;            // 上次有人受傷後出現過的狀態, 用來偵測僵局
+    int pathNodesExpanded;                  // gameplay 自己的 BFS 展開節點數, 另加上 planner.nodesExpanded
+} GameplayBattle;
+
+static GameplayBattle battle;               // 由 GameplayEngine 推進
+static LineOfSightTable lineOfSight;        // 依 grid[][] 預先算好的視線表, 換地圖才重建
+static float battleClock = 0.0f;            // 戰鬥時間 (tick), 依 frame time 推進
+static const Team PLAYER_TEAM = TEAM_BLUE;  // 畫面只顯示這一隊看得到的格子
+static int reportedTurn = 0;
+#if defined(BATTLE_BENCHMARK)
+static unsigned long long turnAllocations = 0;  // 本回合行動中的 heap 配置次數, 應該永遠是 0
+#endif
+static unsigned int battleSeed = 0;         // 地圖與單位的亂數種子, 同 seed 戰鬥結果相同
 static int grid[GRID_HEIGHT][GRID_WIDTH] =
 {
     {0,0,0,0,0,0,0,0},
@@ -47,9 +77,9 @@ static int grid[GRID_HEIGHT][GRID_WIDTH] =
 };
 static int framesCounter = 0;
 static int finishScreen = 0;
-static float turnTimer = 0.0f;
-static const float TURN_INTERVAL = 1.0f;
+static const float TURN_INTERVAL = 1.0f;     // 速度 1 的單位每 TURN_INTERVAL 秒行動一次
 static bool gameOver = false;
+static bool stalemate = false;              // 因僵局結束, winner 由總 hp 決定
 static Team winner;
 
 static int boardOffsetX = 0;
@@ -60,277 +90,180 @@ static const int INFO_PANEL_WIDTH = 200;
 //-------------------------------------------------------------
 // 輔助函數
 //-------------------------------------------------------------
-static int Distance(Unit* a, Unit* b)
+static bool IsWallCell(const GameplayBattle* state, int x, int y)
 {
-    return abs(a->x - b->x) + abs(a->y - b->y);
+    if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) return true;
+    return state->walls[y*GRID_WIDTH + x] == TERRAIN_WALL;
 }
 
-static int DistanceWithBFS(Unit* a, Unit* b)
+// 走格子 (牆擋住) 的 BFS 步數, 到不了回傳 -1; 暫存都在 state->gridSearch, 不配置記憶體
+static int DistanceWithBFS(GameplayBattle* state, int ax, int ay, int bx, int by)
 {
-    struct BFSNode { int x, y, d; };
-
-    static bool visited[GRID_HEIGHT][GRID_WIDTH];
-
-    // 重置 visited
-    for (int y = 0; y < GRID_HEIGHT; y++)
-        for (int x = 0; x < GRID_WIDTH; x++)
-            visited[y][x] = false;
-
-    auto IsBlocked = [&](int x, int y)
-    {
-        if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT)
-            return true;
-
-        if (grid[y][x] == 1) return true; // 障礙物
-
-        return false;
-    };
-
-    std::queue<BFSNode> q;
-    q.push({ a->x, a->y, 0 });
-    visited[a->y][a->x] = true;
+    GridSearch* search = &state->gridSearch;
+    BeginGridSearch(search);
+    PushGridSearch(search, ay*GRID_WIDTH + ax, -1, 0);
 
     int dirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
 
-    while (!q.empty())
+    for (int cur = PopGridSearch(search); cur >= 0; cur = PopGridSearch(search))
     {
-        BFSNode cur = q.front(); q.pop();
+        state->pathNodesExpanded++;
+        int cx = cur%GRID_WIDTH, cy = cur/GRID_WIDTH;
 
-        if (cur.x == b->x && cur.y == b->y)
-            return cur.d;
+        if (cx == bx && cy == by)
+            return search->depth[cur];
 
         for (auto& d : dirs)
         {
-            int nx = cur.x + d[0];
-            int ny = cur.y + d[1];
+            int nx = cx + d[0];
+            int ny = cy + d[1];
 
-            if (!IsBlocked(nx, ny) && !visited[ny][nx])
-            {
-                visited[ny][nx] = true;
-                q.push({ nx, ny, cur.d + 1 });
-            }
+            if (!IsWallCell(state, nx, ny) && !IsGridSearchVisited(search, ny*GRID_WIDTH + nx))
+                PushGridSearch(search, ny*GRID_WIDTH + nx, cur, search->depth[cur] + 1);
         }
     }
 
     return -1; // 找不到路
 }
 
-static bool IsOccupied(int x, int y)
+static bool IsOccupied(const GameplayBattle* state, int x, int y)
 {
-    if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) return true;
-    if (grid[y][x] == 1) return true;
-    for (int i = 0; i < unitCount; i++)
-    {
-        if (units[i].alive && units[i].x == x && units[i].y == y)
-            return true;
-    }
-    return false;
+    if (IsWallCell(state, x, y)) return true;
+    return FindUnitAt(&state->units, x, y) >= 0;
 }
 
-static void GenerateRandomGrid()
+// 從自己做一次距離場 (依地形成本), 取我方看得到的最近敵人 (距離相同取 dense index 小的)
+// 距離場留在 state->planner.distance, FogTargeting::Perceive 與 FindNearestUnseenCell 會接著用
+static int FindNearestEnemy(PathPlanner* planner, const FogOfWar* fog, const UnitStore* units, int u)
 {
-    Unit t1;
-    t1.x = 0;
-    t1.y = 0;
+    BuildDistanceField(planner, units->y[u]*GRID_WIDTH + units->x[u]);
 
-    Unit t2;
-    t2.x = GRID_WIDTH - 1;
-    t2.y = GRID_HEIGHT - 1;
-
-    do
+    int target = -1;
+    int minDist = 999;
+    Team team = GetUnitTeam(u);
+    Team enemyTeam = GetEnemyTeam(team);
+    for (int e = GetTeamBegin(enemyTeam); e < GetTeamEnd(units, enemyTeam); e++)
     {
-        for (int y = 0; y < GRID_HEIGHT; y++)
+        int cell = units->y[e]*GRID_WIDTH + units->x[e];
+        if (!IsCellVisibleToTeam(fog, team, cell)) continue;
+
+        int d = planner->distance[cell];
+        if (d >= 0 && d < minDist)
         {
-            for (int x = 0; x < GRID_WIDTH; x++)
-            {
-                // 避免出生區域被障礙物封死
-                bool isSpawnZoneTop = (y < 3);
-                bool isSpawnZoneBottom = (y > GRID_HEIGHT - 4);
-
-                if (isSpawnZoneTop || isSpawnZoneBottom)
-                {
-                    grid[y][x] = 0;
-                    continue;
-                }
-
-                // 隨機生成障礙物 (20% 機率)
-                int r = GetRandomValue(0, 100);
-                grid[y][x] = (r < 20) ? 1 : 0;
-            }
+            minDist = d;
+            target = e;
         }
-    } 
-    while (DistanceWithBFS(&t1, &t2) < 0);
-}
-
-bool UnitSort(const Unit& a, const Unit& b)
-{
-    // 1. 藍隊在紅隊前
-    if (a.team != b.team)
-        return a.team == TEAM_BLUE;
-
-    // 2. 同是藍隊 => y 小的排前
-    if (a.team == TEAM_BLUE)
-        return a.y < b.y;
-
-    // 3. 同是紅隊 => y 大的排前
-    return a.y > b.y;
-}
-
-static void GenerateRandomUnits()
-{
-    unitCount = 0;
-
-    for (int i = 0; i < MAX_UNITS / 2; i++)
-    {
-        int rx, ry;
-        int bx, by;
-
-        // ---- 產生紅隊 ----
-        do {
-            rx = rand() % GRID_WIDTH;
-            ry = rand() % 4;  // 上方4列
-        } while (grid[ry][rx] == 1 || IsOccupied(rx, ry)); // 避開障礙 & 避免重複
-
-        units[unitCount++] = { rx, ry, 10, 3, TEAM_RED, true };
-
-        // ---- 產生藍隊 ----
-        do {
-            bx = rand() % GRID_WIDTH;
-            by = GRID_HEIGHT - 1 - rand() % 4; // 下方4列
-        } while (grid[by][bx] == 1 || IsOccupied(bx, by)); // 避開障礙 & 避免重複
-
-        units[unitCount++] = { bx, by, 10, 3, TEAM_BLUE, true };
     }
-    std::sort(units, units + unitCount, UnitSort);
+    return target;
 }
 
-static Unit* FindNearestEnemy(Unit* u)
+// 沒有看得到的敵人時去偵察: 我方看不到的格子中最近的一格
+// 沿用 FindNearestEnemy 的距離場: BT_SCOUT 要先感知才會成功, 所以距離場一定是這個單位剛算的
+static int FindNearestUnseenCell(const GameplayBattle* state, Team team)
 {
-    Unit* target = NULL;
+    int best = -1;
     int minDist = 999;
-    for (int i = 0; i < unitCount; i++)
+    for (int c = 0; c < GRID_WIDTH*GRID_HEIGHT; c++)
     {
-        Unit* e = &units[i];
-        if (!e->alive || e->team == u->team) continue;
-        int d = DistanceWithBFS(u, e);
-        if (d < minDist)
+        if (IsCellVisibleToTeam(&state->fog, team, c)) continue;
+        int d = state->planner.distance[c];
+        if (d >= 0 && d < minDist)
         {
             minDist = d;
-            target = e;
+            best = c;
         }
     }
-    return target;
+    return best;
 }
 
-static void MoveTowards(Unit* u, Unit* target)
+// 每回合只重算一次支援 / 威脅圖與兩隊的 cellSafety, 同一回合內的移動都查這份
+static void UpdateTurnInfluence(GameplayBattle* state, int now)
 {
-    if (u->x == target->x && u->y == target->y) return;
+    int turn = now/SCHEDULER_TICKS_PER_TURN;
+    if (turn == state->influenceTurn) return;
 
-    static std::vector<std::vector<bool>> visited(
-        GRID_HEIGHT, std::vector<bool>(GRID_WIDTH, false));
-    static std::vector<std::vector<GamePlayNode>> parent(
-        GRID_HEIGHT, std::vector<GamePlayNode>(GRID_WIDTH));
+    UpdateInfluenceMap(&state->influence, &state->units, state->walls);
+    for (int t = 0; t < TEAM_COUNT; t++)
+        for (int y = 0; y < GRID_HEIGHT; y++)
+            for (int x = 0; x < GRID_WIDTH; x++) state->cellSafety[t][y*GRID_WIDTH + x] = GetCellSafety(&state->influence, (Team)t, x, y);
+    state->influenceTurn = turn;
+}
 
-    // reset
-    for (auto& row : visited) std::fill(row.begin(), row.end(), false);
+// 所有移動都經過這裡, 讓戰場 hash 與尋路的佔位跟著更新 (只動這兩格)
+static void MoveUnit(GameplayBattle* state, int u, int x, int y)
+{
+    UnitStore* units = &state->units;
+    int from = units->y[u]*GRID_WIDTH + units->x[u];
+    int to = y*GRID_WIDTH + x;
+    ToggleZobristUnit(&state->hash, units->handle[u], from, units->hp[u]);
+    units->x[u] = x;
+    units->y[u] = y;
+    ToggleZobristUnit(&state->hash, units->handle[u], to, units->hp[u]);
+    MovePathOccupant(&state->planner, from, to);
+}
 
-    for (auto& row : parent)
-        for (auto& p : row)
-            p = { -1, -1 };
+static void MoveTowards(GameplayBattle* state, int u, int target)
+{
+    const UnitStore* units = &state->units;
+    GridSearch* search = &state->gridSearch;
+    int ux = units->x[u], uy = units->y[u];
+    int tx = units->x[target], ty = units->y[target];
+    if (ux == tx && uy == ty) return;
 
-    auto IsBlocked = [](int x, int y, Unit* self, Unit* dest)
+    auto IsBlocked = [state, units](int x, int y, int self, int dest)
     {
-        if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) return true;
-        if (grid[y][x] == 1) return true;
-        for (int i = 0; i < unitCount; i++)
-            if (&units[i] != dest && &units[i] != self && units[i].alive && units[i].x == x && units[i].y == y)
-                return true;
-        return false;
+        if (IsWallCell(state, x, y)) return true;
+        int other = FindUnitAt(units, x, y);
+        return (other >= 0) && (other != self) && (other != dest);
     };
 
-    std::queue<GamePlayNode> q;
-    q.push({ u->x, u->y });
-    visited[u->y][u->x] = true;
+    int start = uy*GRID_WIDTH + ux;
+    int goal = ty*GRID_WIDTH + tx;
+    BeginGridSearch(search);
+    PushGridSearch(search, start, -1, 0);
 
     int dirs[4][2] = { {0,1},{0,-1},{1,0},{-1,0} };
     bool found = false;
 
-    int visitOrder[GRID_HEIGHT][GRID_WIDTH];
-    for (int y = 0; y < GRID_HEIGHT; y++)
-        for (int x = 0; x < GRID_WIDTH; x++)
-            visitOrder[y][x] = -1;
-
-    int step = 0;
-    while (!q.empty())
+    for (int cur = PopGridSearch(search); cur >= 0; cur = PopGridSearch(search))
     {
-        GamePlayNode cur = q.front(); q.pop();
-        if (cur.x == target->x && cur.y == target->y) {
+        state->pathNodesExpanded++;
+        if (cur == goal) {
             found = true;
             break;
         }
 
+        int cx = cur%GRID_WIDTH, cy = cur/GRID_WIDTH;
         for (int i = 0; i < 4; i++)
         {
-            int nx = cur.x + dirs[i][0];
-            int ny = cur.y + dirs[i][1];
+            int nx = cx + dirs[i][0];
+            int ny = cy + dirs[i][1];
 
-            if (!IsBlocked(nx, ny, u, target) && !visited[ny][nx])
-            {
-                visited[ny][nx] = true;
-                parent[ny][nx] = cur;
-                q.push({ nx, ny });
-                visitOrder[ny][nx] = step++;
-            }
-        }
-    }
-
-    // debug map
-    /*printf("=== BFS Visit Map ===\n");
-    for (int y = 0; y < GRID_HEIGHT; y++)
-    {
-        for (int x = 0; x < GRID_WIDTH; x++)
-        {
-            if (x == u->x && y == u->y) printf("  S ");
-            else if (x == target->x && y == target->y) printf("  E ");
-            else if (visitOrder[y][x] == -1) printf("  - ");
-            else printf("%3d ", visitOrder[y][x]);
+            if (!IsBlocked(nx, ny, u, target) && !IsGridSearchVisited(search, ny*GRID_WIDTH + nx))
+                PushGridSearch(search, ny*GRID_WIDTH + nx, cur, search->depth[cur] + 1);
         }
-        printf("\n");
     }
-    printf("====================\n");*/
 
-    // ✅ 找到路：回溯移動
+    // ✅ 找到路：沿 parent 回溯到起點的下一格
     if (found)
     {
-        std::vector<GamePlayNode> path;
-        GamePlayNode cur = { target->x, target->y };
-        while (!(cur.x == u->x && cur.y == u->y))
-        {
-            path.push_back(cur);
-            cur = parent[cur.y][cur.x];
-        }
-
-        if (path.size() >= 1) {
-            u->x = path[path.size() - 1].x;
-            u->y = path[path.size() - 1].y;
-        }
+        int step = goal;
+        while (search->parent[step] != start) step = search->parent[step];
+        MoveUnit(state, u, step%GRID_WIDTH, step/GRID_WIDTH);
         return;
     }
 
     // ❌ 找不到路：走向更接近敵人的一步
-    int bestX = u->x, bestY = u->y;
-    int bestDist = DistanceWithBFS(u, target);
+    int bestX = ux, bestY = uy;
+    int bestDist = DistanceWithBFS(state, ux, uy, tx, ty);
 
     for (int i = 0; i < 4; i++)
     {
-        int nx = u->x + dirs[i][0];
-        int ny = u->y + dirs[i][1];
-        Unit t;
+        int nx = ux + dirs[i][0];
+        int ny = uy + dirs[i][1];
         if (!IsBlocked(nx, ny, u, target))
         {
-            t.x = nx;
-            t.y = ny;
-            int d = DistanceWithBFS(&t, target);
+            int d = DistanceWithBFS(state, nx, ny, tx, ty);
             if (d < bestDist)
             {
                 bestDist = d;
@@ -341,11 +274,106 @@ static void MoveTowards(Unit* u, Unit* target)
     }
 
     // move if found better spot
-    if (bestX != u->x || bestY != u->y)
+    if (bestX != ux || bestY != uy) MoveUnit(state, u, bestX, bestY);
+}
+
+// 找敵人只看我方視野內的 (依地形成本的距離場), 出手時同步更新戰場 hash 並釋放陣亡單位的預約
+// Perceive 只在 behavior tree 要移動 / 看敵人條件時才被呼叫, 射程內直接出手的行動不算距離場
+struct FogTargeting
+{
+    static BehaviorPerception Perceive(const GameplayBattle* state, int u)
+    {
+        PathPlanner* planner = &state->planner;
+        BehaviorPerception perception;
+        perception.enemy = FindNearestEnemy(planner, &state->fog, &state->units, u);
+        int cost = (perception.enemy >= 0)? planner->distance[state->units.y[perception.enemy]*GRID_WIDTH + state->units.x[perception.enemy]] : 0;
+        perception.enemyDistance = (cost + TERRAIN_FLOOR_COST - 1)/TERRAIN_FLOOR_COST;     // 地形成本換算成空地步數 (無條件進位)
+        return perception;
+    }
+
+    static void Strike(GameplayBattle* state, int u, int target)
+    {
+        UnitStore* units = &state->units;
+        int targetCell = units->y[target]*GRID_WIDTH + units->x[target];
+        ToggleZobristUnit(&state->hash, units->handle[target], targetCell, units->hp[target]);
+        units->hp[target] -= units->attack[u];
+        if (units->hp[target] > 0) ToggleZobristUnit(&state->hash, units->handle[target], targetCell, units->hp[target]);
+        ClearRepetitionTable(&state->repetitions);     // hp 只會減少, 之前的狀態不會再出現
+        if (units->hp[target] <= 0) {
+            ReleasePathReservations(&state->planner, units->handle[target]);
+            MovePathOccupant(&state->planner, targetCell, -1);
+            CompactUnits(units);
+        }
+    }
+
+    static void EndAction(GameplayBattle* state) { UpdateFogOfWar(&state->fog, &state->units); }
+};
+
+// 前進 = 沿著預約好的路線往最近的敵人走; 偵察 = 往我方看不到的最近格子走; 停下來時預約自己的格子到下次行動
+// 路線由 cooperative A* 規劃, 步數相同時偏好 友軍支援 - 敵方威脅 高的格子
+struct CooperativeMovement
+{
+    static void Stay(GameplayBattle* state, int u, int now, int interval)
+    {
+        ReleasePathReservations(&state->planner, state->units.handle[u]);
+        ReserveCell(&state->planner, state->units.y[u]*GRID_WIDTH + state->units.x[u], now, now + interval + 1, state->units.handle[u]);
+    }
+
+    static void Advance(GameplayBattle* state, int u, int enemy, int now, int interval)
+    {
+        MoveToGoal(state, u, state->units.y[enemy]*GRID_WIDTH + state->units.x[enemy], enemy, now, interval);
+    }
+
+    static void Scout(GameplayBattle* state, int u, int now, int interval)
+    {
+        int goal = FindNearestUnseenCell(state, GetUnitTeam(u));
+        if (goal >= 0) MoveToGoal(state, u, goal, -1, now, interval);
+    }
+
+    // 地形在戰鬥中不變, 佔位由 MoveUnit / Strike 逐格更新, 行動後不用再掃整個棋盤
+    static void EndAction(GameplayBattle*) { }
+
+    static void MoveToGoal(GameplayBattle* state, int u, int goal, int enemy, int now, int interval)
     {
-        u->x = bestX;
-        u->y = bestY;
+        UpdateTurnInfluence(state, now);
+
+        int start = state->units.y[u]*GRID_WIDTH + state->units.x[u];
+        int next = PlanCooperativeStep(&state->planner, state->units.handle[u], start, goal, now, interval, state->cellSafety[GetUnitTeam(u)]);
+        if (next < 0) {
+            if (enemy >= 0) MoveTowards(state, u, enemy);      // 牆把目標完全隔開, 只能盡量靠近
+            return;
+        }
+
+        // 沒照預約走的單位 (例如剛規劃失敗而原地等待) 可能還佔著下一格, 這時先等一步
+        if (next != start && !IsOccupied(state, next%GRID_WIDTH, next/GRID_WIDTH)) MoveUnit(state, u, next%GRID_WIDTH, next/GRID_WIDTH);
     }
+};
+
+// 開場: 藍隊在紅隊前, 藍隊 y 小的先, 紅隊 y 大的先; 行動由兵種的 behavior tree 決定 (battle_behavior.h)
+typedef BattleEngine<FormationInitiative, FogTargeting, CooperativeMovement> GameplayEngine;
+
+// 排入第一個事件, 每個單位先預約自己的格子到第一次行動為止
+static void ScheduleInitialActions()
+{
+    ClearPathReservations(&battle.planner);
+    battle.influenceTurn = -1;
+    GameplayEngine::Start(&battle);
+    battleClock = 0.0f;
+    reportedTurn = 0;
+}
+
+// 狀態重複代表單位在擺盪, 戰鬥不會再有進展: 勝負見 GetStalemateWinner
+static void EndInStalemate(int tick)
+{
+    int redAlive, blueAlive;
+    Fixed redHP, blueHP;
+    GetUnitTeamStats(&battle.units, TEAM_RED, &redAlive, &redHP);
+    GetUnitTeamStats(&battle.units, TEAM_BLUE, &blueAlive, &blueHP);
+
+    winner = GetStalemateWinner(&battle.units);
+    gameOver = true;
+    stalemate = true;
+    TraceLog(LOG_INFO, "GAMEPLAY: stalemate at tick %d (red hp %d, blue hp %d)", tick, FixedCeilToInt(redHP), FixedCeilToInt(blueHP));
 }
 
 //-------------------------------------------------------------
@@ -356,16 +384,43 @@ void InitGameplayScreen(void)
     framesCounter = 0;
     finishScreen = 0;
     gameOver = false;
-    unitCount = 0;
+    stalemate = false;
+    InitUnitStore(&battle.units);
+
+#if defined(BATTLE_BENCHMARK)
+    RunInfluenceBenchmark();
+    RunFogBenchmark();
+    RunBehaviorBenchmark();
+#endif
+
+    // 從 GAME_MAP 進來時打地圖選定的那一場, 否則依新的 seed 產生 (battle_encounter.h)
+    static Encounter encounter;
+    if (!TakeHandedOffEncounter(&encounter)) GenerateEncounter((unsigned int)GetRandomValue(0, 0x7fffffff), &encounter);
+    battleSeed = encounter.seed;
+    TraceLog(LOG_INFO, "GAMEPLAY: battle seed %u", battleSeed);
 
     // 棋盤置中
     boardOffsetX = (GetScreenWidth() - INFO_PANEL_WIDTH * 2 - GRID_WIDTH * CELL_SIZE) / 2 + INFO_PANEL_WIDTH;
     boardOffsetY = (GetScreenHeight() - GRID_HEIGHT * CELL_SIZE) / 2;
-    GenerateRandomGrid();
-    GenerateRandomUnits();
-    /*units[unitCount++] = { 0, GRID_HEIGHT - 1, 10, 3, TEAM_BLUE, true };
-    units[unitCount++] = { 0, GRID_HEIGHT - 2, 10, 3, TEAM_BLUE, true };
-    units[unitCount++] = { 0, 0, 10, 3, TEAM_RED, true };*/
+    InitGridSearch(&battle.gridSearch, GRID_WIDTH, GRID_HEIGHT);
+    for (int y = 0; y < GRID_HEIGHT; y++)
+        for (int x = 0; x < GRID_WIDTH; x++) grid[y][x] = encounter.grid[y*GRID_WIDTH + x];
+    BuildLineOfSightTable(&lineOfSight, &grid[0][0], GRID_WIDTH, GRID_HEIGHT);
+    battle.lineOfSight = &lineOfSight;
+    battle.walls = &grid[0][0];
+    battle.pathNodesExpanded = 0;
+    InitInfluenceMap(&battle.influence, GRID_WIDTH, GRID_HEIGHT);
+    InitPathPlanner(&battle.planner, &grid[0][0], GRID_WIDTH, GRID_HEIGHT);
+    InitFogOfWar(&battle.fog, &grid[0][0], GRID_WIDTH, GRID_HEIGHT);
+    battle.units = encounter.units;
+    /*AddUnit(&battle.units, TEAM_BLUE, 0, GRID_HEIGHT - 1, IntToFixed(10), IntToFixed(3), 1, 1, GameData::UNIT_FOOTMAN);
+    AddUnit(&battle.units, TEAM_BLUE, 0, GRID_HEIGHT - 2, IntToFixed(10), IntToFixed(3), 1, 1, GameData::UNIT_FOOTMAN);
+    AddUnit(&battle.units, TEAM_RED, 0, 0, IntToFixed(10), IntToFixed(3), 1, 1, GameData::UNIT_FOOTMAN);*/
+    UpdatePathCosts(&battle.planner, &battle.units);
+    UpdateFogOfWar(&battle.fog, &battle.units);
+    battle.hash = ComputeZobristHash(&battle.units, GRID_WIDTH);
+    ClearRepetitionTable(&battle.repetitions);
+    ScheduleInitialActions();
 }
 
 //-------------------------------------------------------------
@@ -378,55 +433,51 @@ void UpdateGameplayScreen(void)
         return;
     }
 
-    turnTimer += GetFrameTime();
-    if (turnTimer >= TURN_INTERVAL) {
-        turnTimer = 0.0f;
-        std::sort(units, units + unitCount, UnitSort);
-        for (int i = 0; i < unitCount; i++) {
-            Unit* u = &units[i];
-            if (!u->alive) continue;
-
-            Unit* enemy = FindNearestEnemy(u);
-            if (!enemy) continue;
-
-            int dist = Distance(u, enemy);
-            if (dist == 1) {
-                enemy->hp -= u->attack;
-                if (enemy->hp <= 0) enemy->alive = false;
-            }
-            else {
-                MoveTowards(u, enemy);
-            }
-        }
-
-        bool redAlive = false, blueAlive = false;
-        for (int i = 0; i < unitCount; i++) {
-            if (units[i].alive) {
-                if (units[i].team == TEAM_RED) redAlive = true;
-                else blueAlive = true;
-            }
-        }
-        if (!redAlive || !blueAlive) {
+    // 只喚醒行動時間已到的單位; 事件順序只由排程決定, 與 frame rate 無關
+    battleClock += GetFrameTime()/TURN_INTERVAL*SCHEDULER_TICKS_PER_TURN;
+    ScheduledAction action;
+#if defined(BATTLE_BENCHMARK)
+    unsigned long long allocationsBefore = GetAllocationCount();
+#endif
+    while (!gameOver && GameplayEngine::Pop(&battle, (int)battleClock, &action)) {
+        GameplayEngine::Resolve(&battle, &action);
+        if (battle.over) {
             gameOver = true;
-            winner = redAlive ? TEAM_RED : TEAM_BLUE;
+            winner = battle.winner;
+        }
+        // 狀態 = 位置 + hp + 剛行動的是誰 + 排程 + 預約 (位置相同但有人晚一點行動、路線預約不同, 之後的發展也不同)
+        else {
+            uint64_t state = battle.hash ^ MixZobristKey(action.unit) ^ GetZobristSchedulerKey(&battle.scheduler, action.time) ^ GetPathReservationKey(&battle.planner, action.time);
+            if (RecordRepetition(&battle.repetitions, state) >= STALEMATE_REPETITIONS) EndInStalemate(action.time);
         }
     }
+
+#if defined(BATTLE_BENCHMARK)
+    turnAllocations += GetAllocationCount() - allocationsBefore;
+#endif
+
+    // 每回合 (SCHEDULER_TICKS_PER_TURN tick) 回報一次尋路展開的節點數、視野重算次數與 heap 配置次數
+    int turn = (int)battleClock/SCHEDULER_TICKS_PER_TURN;
+    if (turn > reportedTurn) {
+#if defined(BATTLE_BENCHMARK)
+        TraceLog((turnAllocations == 0)? LOG_INFO : LOG_WARNING, "BENCHMARK: turn %d: %d path nodes expanded, %d fog casts, %llu allocations",
+            turn, battle.pathNodesExpanded + battle.planner.nodesExpanded, battle.fog.castCount, turnAllocations);
+        assert(turnAllocations == 0);   // 行動中的暫存都應該在 Init 時配置好
+        turnAllocations = 0;
+#endif
+        battle.pathNodesExpanded = 0;
+        battle.planner.nodesExpanded = 0;
+        battle.fog.castCount = 0;
+        reportedTurn = turn;
+    }
 }
 
 //-------------------------------------------------------------
 // 統計資料
 //-------------------------------------------------------------
-static void GetTeamStats(Team team, int* aliveCount, int* totalHP)
+static void GetTeamStats(Team team, int* aliveCount, Fixed* totalHP)
 {
-    *aliveCount = 0;
-    *totalHP = 0;
-    for (int i = 0; i < unitCount; i++) {
-        Unit* u = &units[i];
-        if (u->alive && u->team == team) {
-            (*aliveCount)++;
-            (*totalHP) += u->hp;
-        }
-    }
+    GetUnitTeamStats(&battle.units, team, aliveCount, totalHP);
 }
 
 //-------------------------------------------------------------
@@ -448,44 +499,53 @@ void DrawGameplayScreen(void)
             // 格線
             DrawRectangleLines(cell.x, cell.y, cell.width, cell.height, DARKGRAY);
 
-            // 如果是障礙物，畫黑色方塊
-            if (grid[y][x] == 1)
+            // 如果是障礙物，畫黑色方塊; 其他地形用淡色底
+            if (grid[y][x] == TERRAIN_WALL)
             {
                 DrawRectangle(cell.x, cell.y, cell.width, cell.height, BLACK);
             }
+            else if (grid[y][x] == TERRAIN_MUD) DrawRectangle(cell.x + 1, cell.y + 1, cell.width - 2, cell.height - 2, Fade(BROWN, 0.5f));
+            else if (grid[y][x] == TERRAIN_ROAD) DrawRectangle(cell.x + 1, cell.y + 1, cell.width - 2, cell.height - 2, Fade(BEIGE, 0.6f));
+            else if (grid[y][x] == TERRAIN_HIGH_GROUND) DrawRectangle(cell.x + 1, cell.y + 1, cell.width - 2, cell.height - 2, Fade(DARKGREEN, 0.35f));
+
+            // 戰爭迷霧: 玩家隊伍看不到的格子變暗
+            if (!IsCellVisibleToTeam(&battle.fog, PLAYER_TEAM, y*GRID_WIDTH + x))
+                DrawRectangle(cell.x, cell.y, cell.width, cell.height, Fade(DARKGRAY, 0.6f));
         }
     }
 
-    // 單位
-    for (int i = 0; i < unitCount; i++) {
-        Unit* u = &units[i];
-        if (!u->alive) continue;
-
-        Color color = (u->team == TEAM_RED) ? RED : BLUE;
-        int cx = boardOffsetX + u->x * CELL_SIZE + CELL_SIZE / 2;
-        int cy = boardOffsetY + u->y * CELL_SIZE + CELL_SIZE / 2;
-        DrawCircle(cx, cy, 10, color);
-        DrawText(TextFormat("%d", u->hp), cx - 8, cy - 8, 14, WHITE);
+    // 單位 (迷霧中的敵人不畫)
+    for (int t = 0; t < TEAM_COUNT; t++) {
+        Color color = (t == TEAM_RED) ? RED : BLUE;
+        for (int i = GetTeamBegin((Team)t); i < GetTeamEnd(&battle.units, (Team)t); i++) {
+            if (!IsCellVisibleToTeam(&battle.fog, PLAYER_TEAM, battle.units.y[i]*GRID_WIDTH + battle.units.x[i])) continue;
+            int cx = boardOffsetX + battle.units.x[i] * CELL_SIZE + CELL_SIZE / 2;
+            int cy = boardOffsetY + battle.units.y[i] * CELL_SIZE + CELL_SIZE / 2;
+            DrawCircle(cx, cy, 10, color);
+            DrawText(TextFormat("%d", FixedCeilToInt(battle.units.hp[i])), cx - 8, cy - 8, 14, WHITE);
+        }
     }
 
     // 資訊欄
-    int redAlive, redHP, blueAlive, blueHP;
+    int redAlive, blueAlive;
+    Fixed redHP, blueHP;
     GetTeamStats(TEAM_RED, &redAlive, &redHP);
     GetTeamStats(TEAM_BLUE, &blueAlive, &blueHP);
 
     DrawText("RED TEAM", 20, 40, 30, WHITE);
     DrawText(TextFormat("Alive: %d", redAlive), 20, 90, 20, WHITE);
-    DrawText(TextFormat("Total HP: %d", redHP), 20, 120, 20, WHITE);
+    DrawText(TextFormat("Total HP: %d", FixedCeilToInt(redHP)), 20, 120, 20, WHITE);
 
     DrawText("BLUE TEAM", GetScreenWidth() - INFO_PANEL_WIDTH + 20, 40, 30, WHITE);
     DrawText(TextFormat("Alive: %d", blueAlive), GetScreenWidth() - INFO_PANEL_WIDTH + 20, 90, 20, WHITE);
-    DrawText(TextFormat("Total HP: %d", blueHP), GetScreenWidth() - INFO_PANEL_WIDTH + 20, 120, 20, WHITE);
+    DrawText(TextFormat("Total HP: %d", FixedCeilToInt(blueHP)), GetScreenWidth() - INFO_PANEL_WIDTH + 20, 120, 20, WHITE);
 
     // 遊戲結束畫面
     if (gameOver) {
         const char* text = (winner == TEAM_RED) ? "RED WINS!" : "BLUE WINS!";
         DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), Fade(BLACK, 0.6f));
         DrawText(text, GetScreenWidth() / 2 - MeasureText(text, 60) / 2, GetScreenHeight() / 2 - 40, 60, YELLOW);
+        if (stalemate) DrawText("Stalemate - decided by total HP", GetScreenWidth() / 2 - MeasureText("Stalemate - decided by total HP", 20) / 2, GetScreenHeight() / 2 + 70, 20, WHITE);
         DrawText("Press ENTER to return", GetScreenWidth() / 2 - 150, GetScreenHeight() / 2 + 40, 20, WHITE);
     }
 }